@@ -254,6 +254,146 @@ public:
     }
 };
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// ScrollEngine Class Declaration
+//
+// Scroll deltas for wheel mice and trackpoint scrolling, configured with the
+// SmoothScroll dictionary:
+//
+//   Resolution    output units per input count (1 = whole detents); only
+//                 for owners that publish it in their scroll resolution, so
+//                 the steps get finer but a detent scrolls as far as before.
+//                 Elsewhere it is ignored.
+//   Acceleration  extra gain in percent when scrolling at FastRate
+//   FastRate      input counts per second for full acceleration
+//   Momentum      friction in per mille per tick, 0 turns momentum off
+//
+// Fractions of a unit are carried in 16.16 fixed point, so nothing is lost
+// when the gain is not a whole number. With Momentum set, tick() keeps
+// scrolling every kScrollTickMS after the input stops, slowing down each
+// tick. The defaults pass the deltas through untouched.
+//
+
+#define kScrollTickMS           10
+#define kScrollIdleNs           250000000ULL
+#define kScrollMomentumMinRate  10      // counts per second needed to coast
+
+class ScrollEngine
+{
+private:
+    SInt64 m_remainder[2];
+    SInt64 m_velocity[2];       // 16.16 output units per tick
+    uint64_t m_lastTime;
+    int m_rate;                 // input counts per second, averaged
+    bool m_subdivide;           // owner scales its scroll resolution by scale()
+
+    static inline SInt64 abs64(SInt64 x) { return x < 0 ? -x : x; }
+    inline int takeWhole(int axis)
+    {
+        int out = (int)(m_remainder[axis] / 65536);
+        m_remainder[axis] -= (SInt64)out * 65536;
+        return out;
+    }
+
+public:
+    int resolution {1};
+    int acceleration {0};
+    int fastRate {40};
+    int momentum {0};
+
+    inline ScrollEngine(bool subdivide = false) : m_subdivide(subdivide) { reset(); m_lastTime = 0; }
+    void reset()
+    {
+        m_remainder[0] = m_remainder[1] = 0;
+        m_velocity[0] = m_velocity[1] = 0;
+        m_rate = 0;
+    }
+    inline int scale() const { return m_subdivide ? resolution : 1; }
+    inline bool isIdentity() const { return scale() == 1 && acceleration == 0 && momentum == 0; }
+    void load(OSDictionary *config)
+    {
+        if (!config)
+            return;
+        const struct {const char *name; int *var;} vars[] = {
+            {"Resolution",      &resolution},
+            {"Acceleration",    &acceleration},
+            {"FastRate",        &fastRate},
+            {"Momentum",        &momentum},
+        };
+        for (int i = 0; i < 4; i++)
+            if (OSNumber *num = OSDynamicCast(OSNumber, config->getObject(vars[i].name)))
+                *vars[i].var = num->unsigned32BitValue();
+        if (resolution < 1)
+            resolution = 1;
+        if (fastRate < 1)
+            fastRate = 1;
+        if (momentum < 0 || momentum >= 1000)
+            momentum = 0;
+        reset();
+    }
+    // Scales axis1 and axis2 in place
+    void feed(int &axis1, int &axis2, uint64_t now_ns)
+    {
+        if (isIdentity())
+            return;
+
+        int counts = (axis1 < 0 ? -axis1 : axis1) + (axis2 < 0 ? -axis2 : axis2);
+        uint64_t elapsed = now_ns - m_lastTime;
+        m_lastTime = now_ns;
+        if (elapsed > kScrollIdleNs) {
+            reset();
+        } else if (counts) {
+            if (elapsed < 1000000)
+                elapsed = 1000000;
+            int rate = (int)(counts * 1000000000ULL / elapsed);
+            m_rate = (m_rate * 3 + rate) / 4;
+        }
+
+        int rate = m_rate < fastRate ? m_rate : fastRate;
+        SInt64 gain = (SInt64)scale() * 65536;
+        gain += gain * acceleration * rate / (100 * fastRate);
+
+        int *axes[2] = {&axis1, &axis2};
+        for (int i = 0; i < 2; i++) {
+            SInt64 delta = *axes[i] * gain;
+            // a fraction left over from the other direction would only add lag
+            if (delta * m_remainder[i] < 0)
+                m_remainder[i] = 0;
+            m_remainder[i] += delta;
+            *axes[i] = takeWhole(i);
+            if (momentum && counts && m_rate >= kScrollMomentumMinRate)
+                m_velocity[i] = delta * m_rate * kScrollTickMS / (1000 * counts);
+            else
+                m_velocity[i] = 0;
+        }
+    }
+    // How long to wait after the last input before coasting, 0 if there is nothing to coast
+    int momentumDelayMS() const
+    {
+        if (!momentum || (!m_velocity[0] && !m_velocity[1]))
+            return 0;
+        int delay = 2000 / (m_rate > 0 ? m_rate : 1);
+        return delay < 2 * kScrollTickMS ? 2 * kScrollTickMS : delay > 150 ? 150 : delay;
+    }
+    // Next momentum step, returns false when it has run out
+    bool tick(int &axis1, int &axis2)
+    {
+        bool moving = false;
+        int *axes[2] = {&axis1, &axis2};
+        for (int i = 0; i < 2; i++) {
+            m_velocity[i] = m_velocity[i] * (1000 - momentum) / 1000;
+            if (abs64(m_velocity[i]) < 65536 / 16)
+                m_velocity[i] = 0;
+            else
+                moving = true;
+            m_remainder[i] += m_velocity[i];
+            *axes[i] = takeWhole(i);
+        }
+        return moving;
+    }
+    inline void stop() { m_velocity[0] = m_velocity[1] = 0; }
+};
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 // PS/2 Command Primitives
 //
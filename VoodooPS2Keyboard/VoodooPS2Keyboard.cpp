@@ -192,6 +192,10 @@ bool ApplePS2Keyboard::init(OSDictionary * dict)
     _macroBuffer = 0;
     _macroCurrent = 0;
     _macroMax = 0;
+    _macroNodes = 0;
+    _macroEdges = 0;
+    _macroAccepts = 0;
+    _macroState = 0;
     _macroMaxTime = 25000000ULL;
     _macroTimer = 0;
 
@@ -296,6 +300,7 @@ ApplePS2Keyboard* ApplePS2Keyboard::probe(IOService * provider, SInt32 * score)
             }
             _macroBuffer = new UInt8[max*kPacketLength];
             _macroMax = max;
+            compileMacroInversion();
         }
     }
     
@@ -959,6 +964,15 @@ void ApplePS2Keyboard::stop(IOService * provider)
         delete[] _macroBuffer;
         _macroBuffer = 0;
     }
+    if (_macroNodes)
+    {
+        delete[] _macroNodes;
+        delete[] _macroEdges;
+        delete[] _macroAccepts;
+        _macroNodes = 0;
+        _macroEdges = 0;
+        _macroAccepts = 0;
+    }
 
     super::stop(provider);
 }
@@ -987,7 +1001,7 @@ IOReturn ApplePS2Keyboard::message(UInt32 type, IOService* provider, void* argum
                     {
                         // mark packet with timestamp
                         clock_get_uptime((uint64_t*)(&packet[kPacketTimeOffset]));
-                        if (!_macroInversion || !invertMacros(packet))
+                        if (!_macroNodes || !invertMacros(packet))
                         {
                             // normal packet
                             dispatchKeyboardEventWithPacket(packet);
@@ -998,14 +1012,14 @@ IOReturn ApplePS2Keyboard::message(UInt32 type, IOService* provider, void* argum
                         // code 3 and 4 indicate send both make and break
                         packet[0] -= 2;
                         clock_get_uptime((uint64_t*)(&packet[kPacketTimeOffset]));
-                        if (!_macroInversion || !invertMacros(packet))
+                        if (!_macroNodes || !invertMacros(packet))
                         {
                             // normal packet (make)
                             dispatchKeyboardEventWithPacket(packet);
                         }
                         clock_get_uptime((uint64_t*)(&packet[kPacketTimeOffset]));
                         packet[1] |= 0x80; // break code
-                        if (!_macroInversion || !invertMacros(packet))
+                        if (!_macroNodes || !invertMacros(packet))
                         {
                             // normal packet (break)
                             dispatchKeyboardEventWithPacket(packet);
@@ -1177,7 +1191,7 @@ void ApplePS2Keyboard::packetReady()
         UInt8* packet = _ringBuffer.tail();
         if (0x00 != packet[0])
         {
-            if (!_macroInversion || !invertMacros(packet))
+            if (!_macroNodes || !invertMacros(packet))
             {
                 // normal packet
                 dispatchKeyboardEventWithPacket(packet);
@@ -1192,22 +1206,131 @@ void ApplePS2Keyboard::packetReady()
     }
 }
 
-bool ApplePS2Keyboard::compareMacro(const UInt8* buffer, const UInt8* data, int count)
+void ApplePS2Keyboard::compileMacroInversion()
 {
-    while (count--)
+    // count macros and the packets in them, indices must fit the trie
+    int count = 0, total = 0;
+    for (OSData** p = _macroInversion; *p; p++, count++)
+        total += ((*p)->getLength()-kPrefixBytes)/kPacketKeyDataLength;
+    if (count >= kMacroNone || total >= kMacroNone)
     {
-        if (buffer[0] != data[0] || buffer[1] != data[1])
-            return false;
-        buffer += kPacketLength;
-        data += kPacketKeyDataLength;
+        IOLog("ApplePS2Keyboard: Macro Inversion too large (%d macros, %d keys), ignored\n", count, total);
+        return;
     }
-    return true;
+
+    // build the trie with linked children, one node per distinct prefix
+    struct BuildNode { UInt16 key, child, sibling, firstPartial, accepts; };
+    BuildNode* build = new BuildNode[total+1];
+    UInt16* acceptNode = new UInt16[count];
+    if (!build || !acceptNode)
+    {
+        delete[] build;
+        delete[] acceptNode;
+        return;
+    }
+    int nodes = 1;
+    build[0] = { 0, kMacroNone, kMacroNone, kMacroNone, 0 };
+    for (int i = 0; i < count; i++)
+    {
+        const UInt8* data = static_cast<const UInt8*>(_macroInversion[i]->getBytesNoCopy());
+        int length = (_macroInversion[i]->getLength()-kPrefixBytes)/kPacketKeyDataLength;
+        const UInt8* sequence = data+kSequenceBytesOffset;
+        int node = 0;
+        for (int j = 0; j < length; j++, sequence += kPacketKeyDataLength)
+        {
+            // macros are added in order, so the first one passing a node is the lowest
+            if (kMacroNone == build[node].firstPartial)
+                build[node].firstPartial = i;
+            UInt16 key = (static_cast<UInt16>(sequence[0]) << 8) | sequence[1];
+            int child = build[node].child;
+            while (kMacroNone != child && build[child].key != key)
+                child = build[child].sibling;
+            if (kMacroNone == child)
+            {
+                child = nodes++;
+                build[child] = { key, kMacroNone, build[node].child, kMacroNone, 0 };
+                build[node].child = child;
+            }
+            node = child;
+        }
+        acceptNode[i] = node;
+        build[node].accepts++;
+    }
+
+    // flatten into arrays, children sorted by key for a binary search
+    _macroNodes = new MacroNode[nodes];
+    _macroEdges = new MacroEdge[nodes];
+    _macroAccepts = new MacroAccept[count];
+    if (_macroNodes && _macroEdges && _macroAccepts)
+    {
+        int edges = 0, accepts = 0;
+        for (int n = 0; n < nodes; n++)
+        {
+            MacroNode& node = _macroNodes[n];
+            node.firstEdge = edges;
+            for (int child = build[n].child; kMacroNone != child; child = build[child].sibling)
+            {
+                int k = edges++;
+                for (; k > node.firstEdge && _macroEdges[k-1].key > build[child].key; k--)
+                    _macroEdges[k] = _macroEdges[k-1];
+                _macroEdges[k].key = build[child].key;
+                _macroEdges[k].node = child;
+            }
+            node.edgeCount = edges - node.firstEdge;
+            node.firstAccept = accepts;
+            node.acceptCount = 0;
+            node.firstPartial = build[n].firstPartial;
+            accepts += build[n].accepts;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            const UInt8* data = static_cast<const UInt8*>(_macroInversion[i]->getBytesNoCopy());
+            MacroNode& node = _macroNodes[acceptNode[i]];
+            MacroAccept& accept = _macroAccepts[node.firstAccept + node.acceptCount++];
+            accept.index = i;
+            accept.mask = (static_cast<UInt16>(data[kModifierBytesOffset+0]) << 8) + data[kModifierBytesOffset+1];
+            accept.compare = (static_cast<UInt16>(data[kModifierBytesOffset+2]) << 8) + data[kModifierBytesOffset+3];
+            accept.output[0] = data[kOutputBytesOffset+0];
+            accept.output[1] = data[kOutputBytesOffset+1];
+        }
+        DEBUG_LOG("ApplePS2Keyboard: Macro Inversion compiled, %d macros, %d nodes\n", count, nodes);
+    }
+    else
+    {
+        delete[] _macroNodes;
+        delete[] _macroEdges;
+        delete[] _macroAccepts;
+        _macroNodes = 0;
+        _macroEdges = 0;
+        _macroAccepts = 0;
+    }
+    _macroState = 0;
+
+    delete[] build;
+    delete[] acceptNode;
+}
+
+int ApplePS2Keyboard::findMacroEdge(int node, UInt16 key) const
+{
+    const MacroEdge* edges = _macroEdges + _macroNodes[node].firstEdge;
+    int low = 0, high = _macroNodes[node].edgeCount;
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+        if (edges[mid].key < key)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (low < _macroNodes[node].edgeCount && edges[low].key == key)
+        return edges[low].node;
+    return -1;
 }
 
 bool ApplePS2Keyboard::invertMacros(const UInt8* packet)
 {
-    assert(_macroInversion);
-    
+    assert(_macroNodes);
+
     if (!_macroTimer || !_macroBuffer)
         return false;
 
@@ -1228,53 +1351,56 @@ bool ApplePS2Keyboard::invertMacros(const UInt8* packet)
         IOLog("diffmin=%lld, diffmax=%lld\n", diffmin, diffmax);
 #endif
     }
- 
-    // add current packet to macro buffer for comparison
+
+    // advance one step in the trie
+    UInt16 key = (static_cast<UInt16>(packet[0]) << 8) | packet[1];
+    int next = findMacroEdge(_macroState, key);
+    if (next < 0 && _macroCurrent > 0)
+    {
+        // buffered packets were not a macro after all, but this one may start one
+        dispatchInvertBuffer();
+        next = findMacroEdge(0, key);
+    }
+    if (next < 0)
+        return false;
+
+    // add current packet to macro buffer
     memcpy(_macroBuffer+_macroCurrent*kPacketLength, packet, kPacketLength);
-    int buffered = _macroCurrent+1;
-    int total = buffered*kPacketKeyDataLength;
-    // compare against macro inversions
-    for (OSData** p = _macroInversion; *p; p++)
+    const MacroNode& node = _macroNodes[next];
+    // same result as scanning Macro Inversion in order: the first macro that
+    // is either complete with matching modifiers or still partial wins
+    for (int i = 0; i < node.acceptCount; i++)
     {
-        int length = (*p)->getLength()-kPrefixBytes;
-        if (total <= length)
+        const MacroAccept& accept = _macroAccepts[node.firstAccept+i];
+        if (accept.index > node.firstPartial)
+            break;
+        if ((0xFFFF == accept.compare && (_PS2modifierState & accept.mask)) || ((_PS2modifierState & accept.mask) == accept.compare))
         {
-            const UInt8* data = static_cast<const UInt8*>((*p)->getBytesNoCopy());
-            if (compareMacro(_macroBuffer, data+kSequenceBytesOffset, buffered))
-            {
-                if (total == length)
-                {
-                    // get modifier mask/compare from macro definition
-                    UInt16 mask = (static_cast<UInt16>(data[kModifierBytesOffset+0]) << 8) + data[kModifierBytesOffset+1];
-                    UInt16 compare = (static_cast<UInt16>(data[kModifierBytesOffset+2]) << 8) + data[kModifierBytesOffset+3];
-                    if ((0xFFFF == compare && (_PS2modifierState & mask)) || ((_PS2modifierState & mask) == compare))
-                    {
-                        // exact match causes macro inversion
-                        // grab bytes from macro definition
-                        _macroBuffer[0] = data[kOutputBytesOffset+0];
-                        _macroBuffer[1] = data[kOutputBytesOffset+1];
-                        // dispatch constructed packet (timestamp is stamp on first macro packet)
-                        dispatchKeyboardEventWithPacket(_macroBuffer);
-                        cancelTimer(_macroTimer);
-                        _macroCurrent = 0;
-                        return true;
-                    }
-                }
-                else
-                {
-                    // partial match, keep waiting for full match
-                    cancelTimer(_macroTimer);
-                    setTimerTimeout(_macroTimer, _macroMaxTime);
-                    _macroCurrent++;
-                    return true;
-                }
-            }
+            // exact match causes macro inversion
+            // grab bytes from macro definition
+            _macroBuffer[0] = accept.output[0];
+            _macroBuffer[1] = accept.output[1];
+            // dispatch constructed packet (timestamp is stamp on first macro packet)
+            dispatchKeyboardEventWithPacket(_macroBuffer);
+            cancelTimer(_macroTimer);
+            _macroCurrent = 0;
+            _macroState = 0;
+            return true;
         }
     }
+    if (kMacroNone != node.firstPartial)
+    {
+        // partial match, keep waiting for full match (onMacroTimer extends the wait)
+        if (0 == _macroCurrent)
+            setTimerTimeout(_macroTimer, _macroMaxTime);
+        _macroCurrent++;
+        _macroState = next;
+        return true;
+    }
     // no match, so... empty macro buffer that may have been existing...
     if (_macroCurrent > 0)
         dispatchInvertBuffer();
-    
+
     return false;
 }
 
@@ -1299,6 +1425,8 @@ void ApplePS2Keyboard::onMacroTimer()
         absolutetime_to_nanoseconds(*(uint64_t*)(&_macroBuffer[(_macroCurrent-1)*kPacketLength+kPacketTimeOffset]), &prev);
         if (now_ns-prev > _macroMaxTime)
             dispatchInvertBuffer();
+        else
+            setTimerTimeout(_macroTimer, prev + _macroMaxTime - now_ns);
     }
 }
 
@@ -1312,6 +1440,7 @@ void ApplePS2Keyboard::dispatchInvertBuffer()
         packet += kPacketLength;
     }
     _macroCurrent = 0;
+    _macroState = 0;
     cancelTimer(_macroTimer);
 }
 
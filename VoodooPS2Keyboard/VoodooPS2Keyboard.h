@@ -68,6 +68,29 @@
 #define kPacketTimeOffset 8
 #define kPacketKeyDataLength 2
 
+// Macro Inversion is compiled into a trie keyed by the key data of each packet
+#define kMacroNone 0xFFFF
+
+struct MacroNode
+{
+    UInt16 firstEdge, edgeCount;        // children in _macroEdges, sorted by key
+    UInt16 firstAccept, acceptCount;    // macros ending here in _macroAccepts, in config order
+    UInt16 firstPartial;                // lowest macro continuing past this node, kMacroNone if none
+};
+
+struct MacroEdge
+{
+    UInt16 key;                         // (packet[0] << 8) | packet[1]
+    UInt16 node;
+};
+
+struct MacroAccept
+{
+    UInt16 index;                       // position in Macro Inversion
+    UInt16 mask, compare;               // modifier criteria
+    UInt8 output[kPacketKeyDataLength];
+};
+
 class EXPORT ApplePS2Keyboard : public IOHIKeyboard
 {
     typedef IOHIKeyboard super;
@@ -123,6 +146,10 @@ private:
     UInt8*                      _macroBuffer;
     int                         _macroMax;
     int                         _macroCurrent;
+    MacroNode*                  _macroNodes;
+    MacroEdge*                  _macroEdges;
+    MacroAccept*                _macroAccepts;
+    int                         _macroState;
     uint64_t                    _macroMaxTime;
     IOTimerEventSource*         _macroTimer;
     
@@ -150,9 +177,10 @@ private:
     static OSData** loadMacroData(OSDictionary* dict, const char* name);
     static void freeMacroData(OSData** data);
     void onMacroTimer(void);
+    void compileMacroInversion();
+    int findMacroEdge(int node, UInt16 key) const;
     bool invertMacros(const UInt8* packet);
     void dispatchInvertBuffer();
-    static bool compareMacro(const UInt8* packet, const UInt8* data, int count);
 
 protected:
     const unsigned char * defaultKeymapOfLength(UInt32 * length) override;
@@ -87,6 +87,9 @@ bool ApplePS2Mouse::init(OSDictionary * dict)
   _buttontime = 0;
   _maxmiddleclicktime = 100000000;
 
+  // state for smooth scrolling
+  _scrollTimer = 0;
+
   // announce version
   extern kmod_info_t kmod_info;
   DEBUG_LOG("VoodooPS2Mouse: Version %s starting on OS X Darwin %d.%d.\n", kmod_info.version, version_major, version_minor);
@@ -123,7 +126,13 @@ void ApplePS2Mouse::setParamPropertiesGated(OSDictionary * config)
     
     OSNumber *num;
     OSBoolean *bl;
+    OSDictionary *scroll;
 
+    if ((scroll = OSDynamicCast(OSDictionary, config->getObject("SmoothScroll"))))
+    {
+        _scrollEngine.load(scroll);
+        setProperty("SmoothScroll", scroll);
+    }
     // 64-bit config items
     for (int i = 0; i < countof(int64vars); i++)
         if ((num=OSDynamicCast(OSNumber, config->getObject(int64vars[i].name))))
@@ -153,6 +162,10 @@ void ApplePS2Mouse::setParamPropertiesGated(OSDictionary * config)
             setProperty(int32vars[i].name, *int32vars[i].var, 32);
         }
     
+    // resetMouse publishes the scroll resolution, keep it in step with changes
+    if (kMouseTypeStandard != _type)
+        setProperty(kIOHIDScrollResolutionKey, ((scrollres * _scrollEngine.scale()) << 16), 32);
+    
     // convert to IOFixed format...
     defres <<= 16;
 }
@@ -302,6 +315,13 @@ bool ApplePS2Mouse::start(IOService * provider)
   if (_buttonTimer)
 	  pWorkLoop->addEventSource(_buttonTimer);
 
+  //
+  // Setup scroll momentum timer event source
+  //
+  _scrollTimer = IOTimerEventSource::timerEventSource(this, OSMemberFunctionCast(IOTimerEventSource::Action, this, &ApplePS2Mouse::onScrollTimer));
+  if (_scrollTimer)
+	  pWorkLoop->addEventSource(_scrollTimer);
+
   //
   // Install our driver's interrupt handler, for asynchronous data delivery.
   //
@@ -365,6 +385,13 @@ void ApplePS2Mouse::stop(IOService * provider)
       _buttonTimer->release();
       _buttonTimer = 0;
     }
+    if (_scrollTimer)
+    {
+      _scrollTimer->cancelTimeout();
+      pWorkLoop->removeEventSource(_scrollTimer);
+      _scrollTimer->release();
+      _scrollTimer = 0;
+    }
   }
     
   //
@@ -471,9 +498,11 @@ void ApplePS2Mouse::resetMouse()
 
     //
     // Report the resolution of the scroll wheel. This property must
-    // be present to enable acceleration for Z-axis movement.
+    // be present to enable acceleration for Z-axis movement. With
+    // SmoothScroll each detent is split in finer units, so the
+    // resolution goes up with it and a detent scrolls as far as before.
     //
-    setProperty(kIOHIDScrollResolutionKey, (scrollres << 16), 32);
+    setProperty(kIOHIDScrollResolutionKey, ((scrollres * _scrollEngine.scale()) << 16), 32);
     setProperty(kIOHIDScrollAccelerationTypeKey, kIOHIDMouseAccelerationType);
   }
   else
@@ -618,6 +647,20 @@ void ApplePS2Mouse::onButtonTimer(void)
     middleButton(lastbuttons, now_abs, fromTimer);
 }
 
+void ApplePS2Mouse::onScrollTimer(void)
+{
+    int axis1, axis2;
+    bool moving = _scrollEngine.tick(axis1, axis2);
+    if (axis1)
+    {
+        uint64_t now_abs;
+        clock_get_uptime(&now_abs);
+        dispatchScrollWheelEventX(axis1, 0, 0, now_abs);
+    }
+    if (moving)
+        _scrollTimer->setTimeoutMS(kScrollTickMS);
+}
+
 UInt32 ApplePS2Mouse::middleButton(UInt32 buttons, uint64_t now_abs, MBComingFrom from)
 {
     if (!_fakemiddlebutton || _buttonCount <= 2)
@@ -804,7 +847,17 @@ void ApplePS2Mouse::dispatchRelativePointerEventWithPacket(UInt8 * packet,
     // and positive when scrolling downwards. Invert this before passing to
     // HID/CG.
     //
-    dispatchScrollWheelEventX(-scrollyinverter*dz, 0, 0, now_abs);
+    int axis1 = -scrollyinverter*dz, axis2 = 0;
+    _scrollEngine.feed(axis1, axis2, now_ns);
+    if (axis1)
+      dispatchScrollWheelEventX(axis1, 0, 0, now_abs);
+    if (_scrollTimer)
+    {
+      if (int delay = _scrollEngine.momentumDelayMS())
+        _scrollTimer->setTimeoutMS(delay);
+      else
+        _scrollTimer->cancelTimeout();
+    }
   }
 
 #ifdef DEBUG_VERBOSE
@@ -1068,6 +1121,9 @@ void ApplePS2Mouse::setDevicePowerState( UInt32 whatToDo )
     {
         case kPS2C_DisableDevice:
             // Disable mouse (synchronous).
+            if (_scrollTimer)
+                _scrollTimer->cancelTimeout();
+            _scrollEngine.stop();
             setMouseEnable( false );
             break;
 
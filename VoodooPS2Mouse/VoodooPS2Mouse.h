@@ -94,6 +94,11 @@ private:
   int _fakemiddlebutton;
     
   void onButtonTimer(void);
+
+  // for smooth scrolling
+  ScrollEngine _scrollEngine {true};
+  IOTimerEventSource* _scrollTimer;
+  void onScrollTimer(void);
   enum MBComingFrom { fromTimer, fromMouse };
   UInt32 middleButton(UInt32 butttons, uint64_t now, MBComingFrom from);
    
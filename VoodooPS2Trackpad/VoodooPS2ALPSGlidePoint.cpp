@@ -360,6 +360,14 @@ bool ApplePS2ALPSGlidePoint::start( IOService * provider ) {
 
     pWorkLoop->addEventSource(_cmdGate);
 
+    _interleavedTimer = IOTimerEventSource::timerEventSource(this, OSMemberFunctionCast(IOTimerEventSource::Action, this, &ApplePS2ALPSGlidePoint::onInterleavedTimer));
+    if (_interleavedTimer)
+        pWorkLoop->addEventSource(_interleavedTimer);
+
+    _scrollTimer = IOTimerEventSource::timerEventSource(this, OSMemberFunctionCast(IOTimerEventSource::Action, this, &ApplePS2ALPSGlidePoint::onScrollTimer));
+    if (_scrollTimer)
+        pWorkLoop->addEventSource(_scrollTimer);
+
     //
     // Lock the controller during initialization
     //
@@ -382,6 +390,13 @@ bool ApplePS2ALPSGlidePoint::start( IOService * provider ) {
     // Install our driver's interrupt handler, for asynchronous data delivery.
     //
 
+    _packetLock = IOSimpleLockAlloc();
+    if (!_packetLock) {
+        _device->unlock();
+        _device->release();
+        return false;
+    }
+
     _device->installInterruptAction(this,
                                     OSMemberFunctionCast(PS2InterruptAction, this, &ApplePS2ALPSGlidePoint::interruptOccurred),
                                     OSMemberFunctionCast(PS2PacketAction, this, &ApplePS2ALPSGlidePoint::packetReady));
@@ -443,6 +458,20 @@ void ApplePS2ALPSGlidePoint::stop(IOService *provider) {
             _cmdGate->release();
             _cmdGate = 0;
         }
+        if (_interleavedTimer)
+        {
+            _interleavedTimer->cancelTimeout();
+            pWorkLoop->removeEventSource(_interleavedTimer);
+            _interleavedTimer->release();
+            _interleavedTimer = 0;
+        }
+        if (_scrollTimer)
+        {
+            _scrollTimer->cancelTimeout();
+            pWorkLoop->removeEventSource(_scrollTimer);
+            _scrollTimer->release();
+            _scrollTimer = 0;
+        }
     }
 
     //
@@ -455,6 +484,12 @@ void ApplePS2ALPSGlidePoint::stop(IOService *provider) {
         _interruptHandlerInstalled = false;
     }
 
+    if (_packetLock)
+    {
+        IOSimpleLockFree(_packetLock);
+        _packetLock = nullptr;
+    }
+
     //
     // Uninstall the power control handler.
     //
@@ -480,7 +515,17 @@ PS2InterruptResult ApplePS2ALPSGlidePoint::interruptOccurred(UInt8 data) {
     // events need to be delivered. Process the trackpad data. Do NOT issue
     // any BLOCKING commands to our device in this context.
     //
+    // Bytes arrive in primary interrupt context, the interleaved flush timer
+    // runs on the workloop, so both take _packetLock around the packet state.
+    //
+
+    IOInterruptState state = IOSimpleLockLockDisableInterrupt(_packetLock);
+    PS2InterruptResult result = alps_process_byte(data);
+    IOSimpleLockUnlockEnableInterrupt(_packetLock, state);
+    return result;
+}
 
+PS2InterruptResult ApplePS2ALPSGlidePoint::alps_process_byte(UInt8 data) {
     UInt8 *packet = _ringBuffer.head();
 
     /* Save first packet */
@@ -488,9 +533,6 @@ PS2InterruptResult ApplePS2ALPSGlidePoint::interruptOccurred(UInt8 data) {
         packet[0] = data;
     }
 
-    /* Reset PSMOUSE_BAD_DATA flag */
-    priv.PSMOUSE_BAD_DATA = false;
-
     /*
      * Check if we are dealing with a bare PS/2 packet, presumably from
      * a device connected to the external PS/2 port. Because bare PS/2
@@ -500,83 +542,181 @@ PS2InterruptResult ApplePS2ALPSGlidePoint::interruptOccurred(UInt8 data) {
      */
     if (priv.proto_version != ALPS_PROTO_V8 &&
         (packet[0] & 0xc8) == 0x08) {
-        if (_packetByteCount == 3) {
-            DEBUG_LOG("%s: Dealing with bare PS/2 packet\n", getName());
-            //dispatchRelativePointerEventWithPacket(packet, kPacketLengthSmall); //Dr Hurt: allow this?
-            priv.PSMOUSE_BAD_DATA = true;
-            _ringBuffer.advanceHead(priv.pktsize);
-            return kPS2IR_packetReady;
-        }
         packet[_packetByteCount++] = data;
-        return kPS2IR_packetBuffering;
+        if (_packetByteCount < kPacketLengthSmall)
+            return kPS2IR_packetBuffering;
+
+        alps_queue_bare_ps2_packet(packet);
+        _barePS2Packets++;
+        _packetByteCount = 0;
+        return kPS2IR_packetReady;
     }
 
     /* Check for PS/2 packet stuffed in the middle of ALPS packet. */
-    if ((priv.flags & ALPS_PS2_INTERLEAVED) &&
-        _packetByteCount >= 4 && (packet[3] & 0x0f) == 0x0f) {
-        priv.PSMOUSE_BAD_DATA = true;
-        _ringBuffer.advanceHead(priv.pktsize);
-        return kPS2IR_packetReady;
+    if ((priv.flags & ALPS_PS2_INTERLEAVED) && _packetByteCount >= 3 &&
+        ((_packetByteCount == 3 ? data : packet[3]) & 0x0f) == 0x0f) {
+        return alps_handle_interleaved_ps2(packet, data);
     }
 
     /* alps_is_valid_first_byte */
     if ((packet[0] & priv.mask0) != priv.byte0) {
-        priv.PSMOUSE_BAD_DATA = true;
-        _ringBuffer.advanceHead(priv.pktsize);
-        return kPS2IR_packetReady;
+        return alps_drop_packet();
     }
 
-    /* Bytes 2 - pktsize should have 0 in the highest bit */
-    if (priv.proto_version < ALPS_PROTO_V5 &&
-        _packetByteCount >= 2 && _packetByteCount <= priv.pktsize &&
-        (packet[_packetByteCount - 1] & 0x80)) {
-        priv.PSMOUSE_BAD_DATA = true;
-        _ringBuffer.advanceHead(priv.pktsize);
-        return kPS2IR_packetReady;
+    /* Protocol specific checks of the previous byte, see alps_setup_packet_checks() */
+    if (_packetByteCount >= 2 && _packetByteCount <= priv.pktsize &&
+        (packet[_packetByteCount - 1] & priv.byte_mask[_packetByteCount - 1]) != priv.byte_value[_packetByteCount - 1]) {
+        return alps_drop_packet();
     }
 
-    /* alps_is_valid_package_v7 */
-    if (priv.proto_version == ALPS_PROTO_V7 &&
-        (((_packetByteCount == 3) && ((packet[2] & 0x40) != 0x40)) ||
-         ((_packetByteCount == 4) && ((packet[3] & 0x48) != 0x48)) ||
-         ((_packetByteCount == 6) && ((packet[5] & 0x40) != 0x0)))) {
-        priv.PSMOUSE_BAD_DATA = true;
+    packet[_packetByteCount++] = data;
+    if (_packetByteCount == priv.pktsize)
+    {
         _ringBuffer.advanceHead(priv.pktsize);
+        _packetByteCount = 0;
         return kPS2IR_packetReady;
     }
+    return kPS2IR_packetBuffering;
+}
 
-    /* alps_is_valid_package_ss4_v2 */
-    if (priv.proto_version == ALPS_PROTO_V8 &&
-        ((_packetByteCount == 4 && ((packet[3] & 0x08) != 0x08)) ||
-         (_packetByteCount == 6 && ((packet[5] & 0x10) != 0x0)))) {
-        priv.PSMOUSE_BAD_DATA = true;
-        _ringBuffer.advanceHead(priv.pktsize);
+/*
+ * Devices with ALPS_PS2_INTERLEAVED may push a 3 byte trackstick packet into
+ * bytes 3-5 of a touchpad packet. A complete 6 byte packet is held back until
+ * the next byte tells the two cases apart, or until the flush timer fires if
+ * nothing follows. Runs under _packetLock; the timer is armed from packetReady
+ * on the workloop rather than from interrupt context.
+ */
+PS2InterruptResult ApplePS2ALPSGlidePoint::alps_handle_interleaved_ps2(UInt8 *packet, UInt8 data) {
+    if (_packetByteCount < priv.pktsize - 1) {
+        packet[_packetByteCount++] = data;
+        return kPS2IR_packetBuffering;
+    }
+
+    if (_packetByteCount == priv.pktsize - 1) {
+        packet[_packetByteCount++] = data;
+        // wake packetReady so it arms the flush timer for this packet
+        _heldPackets++;
         return kPS2IR_packetReady;
     }
 
-    packet[_packetByteCount++] = data;
-    if (_packetByteCount == priv.pktsize)
-    {
+    if (data & 0x80) {
+        /*
+         * Highest bit is set - that means we either had complete ALPS packet
+         * and this is start of the next packet or we got garbage.
+         */
+        if (((packet[3] | packet[4] | packet[5]) & 0x80) ||
+            (data & priv.mask0) != priv.byte0) {
+            return alps_drop_packet();
+        }
+
         _ringBuffer.advanceHead(priv.pktsize);
+
+        /* Continue with the next packet */
+        _ringBuffer.head()[0] = data;
+        _packetByteCount = 1;
         return kPS2IR_packetReady;
     }
-    return kPS2IR_packetBuffering;
+
+    /*
+     * High bit is 0 - that means that we indeed got a PS/2 packet in the
+     * middle of ALPS packet. Pass it on and continue with the ALPS packet,
+     * resetting the 4th bit which is normally 1 so that we don't take it
+     * for an interleaved packet again if all buttons are pressed.
+     */
+    alps_queue_bare_ps2_packet(&packet[3]);
+    _interleavedPS2Packets++;
+    packet[3] = data & 0xf7;
+    _packetByteCount = 4;
+    return kPS2IR_packetReady;
+}
+
+PS2InterruptResult ApplePS2ALPSGlidePoint::alps_drop_packet() {
+    /* Might need to perform a full HW reset here if we keep receiving bad packets (consecutively) */
+    _packetByteCount = 0;
+    _droppedPackets++;
+    return kPS2IR_packetReady;
+}
+
+void ApplePS2ALPSGlidePoint::alps_queue_bare_ps2_packet(const UInt8 *packet) {
+    memcpy(_trackstickRingBuffer.head(), packet, kPacketLengthSmall);
+    _trackstickRingBuffer.advanceHead(kPacketLengthSmall);
+}
+
+void ApplePS2ALPSGlidePoint::onInterleavedTimer() {
+    //
+    // Nothing followed the held back packet, so it was a plain ALPS packet.
+    // Runs on the workloop while bytes keep arriving in interrupt context, so
+    // the flush is done under _packetLock and only if the packet the timer was
+    // armed for is still the one held back.
+    //
+    bool flushed = false;
+    IOInterruptState state = IOSimpleLockLockDisableInterrupt(_packetLock);
+    if (_packetByteCount == priv.pktsize && _heldPackets == _heldPacketsArmed) {
+        UInt8 *packet = _ringBuffer.head();
+        _packetByteCount = 0;
+        if ((packet[3] | packet[4] | packet[5]) & 0x80) {
+            _droppedPackets++;
+        } else {
+            _ringBuffer.advanceHead(priv.pktsize);
+            flushed = true;
+        }
+    }
+    IOSimpleLockUnlockEnableInterrupt(_packetLock, state);
+
+    if (flushed)
+        _device->packetActionInterrupt();
 }
 
 void ApplePS2ALPSGlidePoint::packetReady() {
+    // a complete packet is held back to look for an interleaved PS/2 packet,
+    // give the next byte 20ms to show up before it is flushed as is
+    UInt32 held = _heldPackets;
+    if (held != _heldPacketsArmed && _interleavedTimer) {
+        _heldPacketsArmed = held;
+        _interleavedTimer->setTimeoutMS(20);
+    }
+
+    // deliver trackstick packets recovered from the PS/2 stream...
+    while (_trackstickRingBuffer.count() >= kPacketLengthSmall) {
+        if (!ignoreall)
+            alps_report_bare_ps2_packet(_trackstickRingBuffer.tail());
+        _trackstickRingBuffer.advanceTail(kPacketLengthSmall);
+    }
+
     // empty the ring buffer, dispatching each packet...
     while (_ringBuffer.count() >= priv.pktsize) {
         UInt8 *packet = _ringBuffer.tail();
-        if (priv.PSMOUSE_BAD_DATA == false) {
-            if (!ignoreall)
-                (this->*process_packet)(packet);
-        } else {
-            IOLog("%s: an invalid or bare packet has been dropped...\n", getName());
-            /* Might need to perform a full HW reset here if we keep receiving bad packets (consecutively) */
-        }
-        _packetByteCount = 0;
+        if (!ignoreall)
+            (this->*process_packet)(packet);
         _ringBuffer.advanceTail(priv.pktsize);
     }
+
+    UInt32 dropped = _droppedPackets;
+    if (dropped != _droppedPacketsLogged) {
+        IOLog("%s: %u invalid packet(s) dropped (%u bare and %u interleaved PS/2 packets recovered so far)\n",
+              getName(), dropped - _droppedPacketsLogged, _barePS2Packets, _interleavedPS2Packets);
+        _droppedPacketsLogged = dropped;
+        publishPacketStats();
+    }
+}
+
+void ApplePS2ALPSGlidePoint::alps_report_bare_ps2_packet(const UInt8 *packet) {
+    int buttons = packet[0] & 0x07;
+    int x = packet[1] ? packet[1] - ((packet[0] << 4) & 0x100) : 0;
+    int y = packet[2] ? ((packet[0] << 3) & 0x100) - packet[2] : 0;
+
+    /* If middle button is pressed, switch to scroll mode. Else, move pointer normally */
+    if (0 == (buttons & 0x04)) {
+        voodooTrackpoint(kIOMessageVoodooTrackpointRelativePointer, x, y, buttons);
+    } else {
+        voodooTrackpoint(kIOMessageVoodooTrackpointScrollWheel, x, y, buttons);
+    }
+}
+
+void ApplePS2ALPSGlidePoint::publishPacketStats() {
+    setProperty("Dropped Packets", _droppedPackets, 32);
+    setProperty("Bare PS/2 Packets", _barePS2Packets, 32);
+    setProperty("Interleaved PS/2 Packets", _interleavedPS2Packets, 32);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -585,8 +725,17 @@ bool ApplePS2ALPSGlidePoint::deviceSpecificInit() {
 
     // Setup expected packet size
     priv.pktsize = priv.proto_version == ALPS_PROTO_V4 ? 8 : 6;
+    alps_setup_packet_checks();
+
+    uint64_t start_abs, end_abs, init_ns;
+    clock_get_uptime(&start_abs);
+    bool ok = (this->*hw_init)();
+    clock_get_uptime(&end_abs);
+    absolutetime_to_nanoseconds(end_abs - start_abs, &init_ns);
+    setProperty("Init Time (us)", init_ns / 1000, 32);
+    DEBUG_LOG("%s: hardware init took %llu us\n", getName(), init_ns / 1000);
 
-    if (!(this->*hw_init)()) {
+    if (!ok) {
         goto init_fail;
     }
 
@@ -603,6 +752,39 @@ init_fail:
 /* ============================================================================================== */
 
 
+/*
+ * Build the per byte framing checks used by interruptOccurred. Byte n of
+ * a packet is valid when (byte & byte_mask[n]) == byte_value[n]. Doing
+ * this once per protocol keeps the version checks out of the per byte
+ * path.
+ */
+void ApplePS2ALPSGlidePoint::alps_setup_packet_checks() {
+    memset(priv.byte_mask, 0, sizeof(priv.byte_mask));
+    memset(priv.byte_value, 0, sizeof(priv.byte_value));
+
+    /* Bytes 2 - pktsize should have 0 in the highest bit */
+    if (priv.proto_version < ALPS_PROTO_V5) {
+        for (int i = 1; i < priv.pktsize; i++)
+            priv.byte_mask[i] = 0x80;
+    }
+
+    /* alps_is_valid_package_v7 */
+    if (priv.proto_version == ALPS_PROTO_V7) {
+        priv.byte_mask[2] = 0x40;
+        priv.byte_value[2] = 0x40;
+        priv.byte_mask[3] = 0x48;
+        priv.byte_value[3] = 0x48;
+        priv.byte_mask[5] = 0x40;
+    }
+
+    /* alps_is_valid_package_ss4_v2 */
+    if (priv.proto_version == ALPS_PROTO_V8) {
+        priv.byte_mask[3] = 0x08;
+        priv.byte_value[3] = 0x08;
+        priv.byte_mask[5] = 0x10;
+    }
+}
+
 void ApplePS2ALPSGlidePoint::alps_process_packet_v1_v2(UInt8 *packet) {
 
     // Check if input is disabled via ApplePS2Keyboard request
@@ -706,23 +888,27 @@ static void alps_get_bitmap_points(unsigned int map,
                                    int *fingers)
 {
     struct alps_bitmap_point *point;
-    int i, bit, prev_bit = 0;
+    int offset = 0, zeros, ones;
 
+    /*
+     * Walk the map one run of set bits at a time. The first run goes
+     * into low, every following run overwrites high, so high ends up
+     * holding the last run.
+     */
     point = low;
-    for (i = 0; map != 0; i++, map >>= 1) {
-        bit = map & 1;
-        if (bit) {
-            if (!prev_bit) {
-                point->start_bit = i;
-                point->num_bits = 0;
-                (*fingers)++;
-            }
-            point->num_bits++;
-        } else {
-            if (prev_bit)
-                point = high;
-        }
-        prev_bit = bit;
+    while (map != 0) {
+        zeros = __builtin_ctz(map);
+        map >>= zeros;
+        offset += zeros;
+
+        ones = __builtin_ctzll(~(unsigned long long)map);
+        point->start_bit = offset;
+        point->num_bits = ones;
+        (*fingers)++;
+
+        point = high;
+        offset += ones;
+        map = ones < 32 ? map >> ones : 0;
     }
 }
 
@@ -741,6 +927,7 @@ int ApplePS2ALPSGlidePoint::alps_process_bitmap(struct alps_data *priv,
 {
 
     int i, fingers_x = 0, fingers_y = 0, fingers, closest;
+    int x1, x2, y1, y2;
     struct alps_bitmap_point x_low = {0,}, x_high = {0,};
     struct alps_bitmap_point y_low = {0,}, y_high = {0,};
     struct input_mt_pos corner[4];
@@ -777,42 +964,47 @@ int ApplePS2ALPSGlidePoint::alps_process_bitmap(struct alps_data *priv,
         y_high.num_bits = max(i, 1);
     }
 
-    /* top-left corner */
-    corner[0].x = (priv->x_max * (2 * x_low.start_bit + x_low.num_bits - 1)) /
-    (2 * (priv->x_bits - 1));
-    corner[0].y = (priv->y_max * (2 * y_low.start_bit + y_low.num_bits - 1)) /
-    (2 * (priv->y_bits - 1));
-
-    /* top-right corner */
-    corner[1].x = (priv->x_max * (2 * x_high.start_bit + x_high.num_bits - 1)) /
+    /*
+     * The corners of the bounding box only take two distinct values per
+     * axis, so compute those once and build the corners from them.
+     */
+    x1 = (priv->x_max * (2 * x_low.start_bit + x_low.num_bits - 1)) /
     (2 * (priv->x_bits - 1));
-    corner[1].y = (priv->y_max * (2 * y_low.start_bit + y_low.num_bits - 1)) /
-    (2 * (priv->y_bits - 1));
-
-    /* bottom-right corner */
-    corner[2].x = (priv->x_max * (2 * x_high.start_bit + x_high.num_bits - 1)) /
+    x2 = (priv->x_max * (2 * x_high.start_bit + x_high.num_bits - 1)) /
     (2 * (priv->x_bits - 1));
-    corner[2].y = (priv->y_max * (2 * y_high.start_bit + y_high.num_bits - 1)) /
+    y1 = (priv->y_max * (2 * y_low.start_bit + y_low.num_bits - 1)) /
     (2 * (priv->y_bits - 1));
-
-    /* bottom-left corner */
-    corner[3].x = (priv->x_max * (2 * x_low.start_bit + x_low.num_bits - 1)) /
-    (2 * (priv->x_bits - 1));
-    corner[3].y = (priv->y_max * (2 * y_high.start_bit + y_high.num_bits - 1)) /
+    y2 = (priv->y_max * (2 * y_high.start_bit + y_high.num_bits - 1)) /
     (2 * (priv->y_bits - 1));
 
     /* x-bitmap order is reversed on v5 touchpads  */
     if (priv->proto_version == ALPS_PROTO_V5) {
-        for (i = 0; i < 4; i++)
-            corner[i].x = priv->x_max - corner[i].x;
+        x1 = priv->x_max - x1;
+        x2 = priv->x_max - x2;
     }
 
     /* y-bitmap order is reversed on v3 and v4 touchpads  */
     if (priv->proto_version == ALPS_PROTO_V3 || priv->proto_version == ALPS_PROTO_V4) {
-        for (i = 0; i < 4; i++)
-            corner[i].y = priv->y_max - corner[i].y;
+        y1 = priv->y_max - y1;
+        y2 = priv->y_max - y2;
     }
 
+    /* top-left corner */
+    corner[0].x = x1;
+    corner[0].y = y1;
+
+    /* top-right corner */
+    corner[1].x = x2;
+    corner[1].y = y1;
+
+    /* bottom-right corner */
+    corner[2].x = x2;
+    corner[2].y = y2;
+
+    /* bottom-left corner */
+    corner[3].x = x1;
+    corner[3].y = y2;
+
     /*
      * We only select a corner for the second touch once per 2 finger
      * touch sequence to avoid the chosen corner (and thus the coordinates)
@@ -1740,102 +1932,123 @@ void ApplePS2ALPSGlidePoint::alps_process_packet_ss4_v2(UInt8 *packet) {
     alps_buttons(f);
 }
 
-bool ApplePS2ALPSGlidePoint::alps_command_mode_send_nibble(int nibble) {
+/*
+ * The command mode helpers below append their PS/2 commands to a single
+ * request, so that a whole register access (address command, four address
+ * nibbles and the data nibbles or the read back) is one submitRequestAndBlock
+ * instead of one per nibble. A read is 13 commands, a write is 13 commands,
+ * both well within kMaxCommands. Any failing command truncates commandsCount,
+ * so the access fails as a whole just like the nibble by nibble version did.
+ */
+bool ApplePS2ALPSGlidePoint::alps_append_nibble(PS2Request *request, int &cmd, int nibble) {
     SInt32 command;
-    // The largest amount of requests we will have is 2 right now
-    // 1 for the initial command, and 1 for sending data OR 1 for receiving data
-    // If the nibble commands at the top change then this will need to change as
-    // well. For now we will just validate that the request will not overload
-    // this object.
-    TPS2Request<2> request;
-    int cmdCount = 0, send = 0, receive = 0, i;
+    int send = 0, receive = 0, i;
 
     if (nibble > 0xf) {
         IOLog("%s::alps_command_mode_send_nibble ERROR: nibble value is greater than 0xf, command may fail\n", getName());
     }
 
-    request.commands[cmdCount].command = kPS2C_SendCommandAndCompareAck;
     command = priv.nibble_commands[nibble].command;
-    request.commands[cmdCount++].inOrOut = command & 0xff;
-
     send = (command >> 12 & 0xf);
     receive = (command >> 8 & 0xf);
 
+    // At most 1 command and 1 byte sent or received per nibble
     if ((send > 1) || ((send + receive + 1) > 2)) {
         return false;
     }
 
+    request->commands[cmd].command = kPS2C_SendCommandAndCompareAck;
+    request->commands[cmd++].inOrOut = command & 0xff;
+
     if (send > 0) {
-        request.commands[cmdCount].command = kPS2C_SendCommandAndCompareAck;
-        request.commands[cmdCount++].inOrOut = priv.nibble_commands[nibble].data;
+        request->commands[cmd].command = kPS2C_SendCommandAndCompareAck;
+        request->commands[cmd++].inOrOut = priv.nibble_commands[nibble].data;
     }
 
     for (i = 0; i < receive; i++) {
-        request.commands[cmdCount].command = kPS2C_ReadDataPort;
-        request.commands[cmdCount++].inOrOut = 0;
+        request->commands[cmd].command = kPS2C_ReadDataPort;
+        request->commands[cmd++].inOrOut = 0;
+    }
+
+    return true;
+}
+
+bool ApplePS2ALPSGlidePoint::alps_append_set_addr(PS2Request *request, int &cmd, int addr) {
+    int i;
+
+    // DEBUG_LOG("%s: command mode set addr with addr command: 0x%02x\n", getName(), priv.addr_command);
+    request->commands[cmd].command = kPS2C_SendCommandAndCompareAck;
+    request->commands[cmd++].inOrOut = priv.addr_command;
+
+    for (i = 12; i >= 0; i -= 4) {
+        if (!alps_append_nibble(request, cmd, (addr >> i) & 0xf)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool ApplePS2ALPSGlidePoint::alps_command_mode_send_nibble(int nibble) {
+    TPS2Request<2> request;
+    int cmdCount = 0;
+
+    if (!alps_append_nibble(&request, cmdCount, nibble)) {
+        return false;
     }
 
     request.commandsCount = cmdCount;
     assert(request.commandsCount <= countof(request.commands));
-
     _device->submitRequestAndBlock(&request);
 
     return request.commandsCount == cmdCount;
 }
 
 bool ApplePS2ALPSGlidePoint::alps_command_mode_set_addr(int addr) {
+    TPS2Request<9> request;
+    int cmdCount = 0;
 
-    TPS2Request<1> request;
-    int i, nibble;
-
-    // DEBUG_LOG("%s: command mode set addr with addr command: 0x%02x\n", getName(), priv.addr_command);
-    request.commands[0].command = kPS2C_SendCommandAndCompareAck;
-    request.commands[0].inOrOut = priv.addr_command;
-    request.commandsCount = 1;
-    _device->submitRequestAndBlock(&request);
-
-    if (request.commandsCount != 1) {
+    if (!alps_append_set_addr(&request, cmdCount, addr)) {
         return false;
     }
 
-    for (i = 12; i >= 0; i -= 4) {
-        nibble = (addr >> i) & 0xf;
-        if (!alps_command_mode_send_nibble(nibble)) {
-            return false;
-        }
-    }
+    request.commandsCount = cmdCount;
+    assert(request.commandsCount <= countof(request.commands));
+    _device->submitRequestAndBlock(&request);
 
-    return true;
+    return request.commandsCount == cmdCount;
 }
 
 int ApplePS2ALPSGlidePoint::alps_command_mode_read_reg(int addr) {
-    TPS2Request<4> request;
+    TPS2Request<13> request;
     ALPSStatus_t status;
+    int cmdCount = 0, byte0;
 
-    if (!alps_command_mode_set_addr(addr)) {
+    if (!alps_append_set_addr(&request, cmdCount, addr)) {
         DEBUG_LOG("%s: Failed to set addr to read register\n", getName());
         return -1;
     }
 
-    request.commands[0].command = kPS2C_SendCommandAndCompareAck;
-    request.commands[0].inOrOut = kDP_GetMouseInformation; //sync..
-    request.commands[1].command = kPS2C_ReadDataPort;
-    request.commands[1].inOrOut = 0;
-    request.commands[2].command = kPS2C_ReadDataPort;
-    request.commands[2].inOrOut = 0;
-    request.commands[3].command = kPS2C_ReadDataPort;
-    request.commands[3].inOrOut = 0;
-    request.commandsCount = 4;
+    request.commands[cmdCount].command = kPS2C_SendCommandAndCompareAck;
+    request.commands[cmdCount++].inOrOut = kDP_GetMouseInformation; //sync..
+    byte0 = cmdCount;
+    request.commands[cmdCount].command = kPS2C_ReadDataPort;
+    request.commands[cmdCount++].inOrOut = 0;
+    request.commands[cmdCount].command = kPS2C_ReadDataPort;
+    request.commands[cmdCount++].inOrOut = 0;
+    request.commands[cmdCount].command = kPS2C_ReadDataPort;
+    request.commands[cmdCount++].inOrOut = 0;
+    request.commandsCount = cmdCount;
     assert(request.commandsCount <= countof(request.commands));
     _device->submitRequestAndBlock(&request);
 
-    if (request.commandsCount != 4) {
+    if (request.commandsCount != cmdCount) {
         return -1;
     }
 
-    status.bytes[0] = request.commands[1].inOrOut;
-    status.bytes[1] = request.commands[2].inOrOut;
-    status.bytes[2] = request.commands[3].inOrOut;
+    status.bytes[0] = request.commands[byte0].inOrOut;
+    status.bytes[1] = request.commands[byte0+1].inOrOut;
+    status.bytes[2] = request.commands[byte0+2].inOrOut;
 
     // IOLog("%s: read reg result: { 0x%02x, 0x%02x, 0x%02x }\n", getName(), status.bytes[0], status.bytes[1], status.bytes[2]);
 
@@ -1852,23 +2065,36 @@ int ApplePS2ALPSGlidePoint::alps_command_mode_read_reg(int addr) {
 }
 
 bool ApplePS2ALPSGlidePoint::alps_command_mode_write_reg(int addr, UInt8 value) {
+    TPS2Request<13> request;
+    int cmdCount = 0;
 
-    if (!alps_command_mode_set_addr(addr)) {
+    if (!(alps_append_set_addr(&request, cmdCount, addr) &&
+          alps_append_nibble(&request, cmdCount, (value >> 4) & 0xf) &&
+          alps_append_nibble(&request, cmdCount, value & 0xf))) {
         return false;
     }
 
-    return alps_command_mode_write_reg(value);
+    request.commandsCount = cmdCount;
+    assert(request.commandsCount <= countof(request.commands));
+    _device->submitRequestAndBlock(&request);
+
+    return request.commandsCount == cmdCount;
 }
 
 bool ApplePS2ALPSGlidePoint::alps_command_mode_write_reg(UInt8 value) {
-    if (!alps_command_mode_send_nibble((value >> 4) & 0xf)) {
-        return false;
-    }
-    if (!alps_command_mode_send_nibble(value & 0xf)) {
+    TPS2Request<4> request;
+    int cmdCount = 0;
+
+    if (!(alps_append_nibble(&request, cmdCount, (value >> 4) & 0xf) &&
+          alps_append_nibble(&request, cmdCount, value & 0xf))) {
         return false;
     }
 
-    return true;
+    request.commandsCount = cmdCount;
+    assert(request.commandsCount <= countof(request.commands));
+    _device->submitRequestAndBlock(&request);
+
+    return request.commandsCount == cmdCount;
 }
 
 bool ApplePS2ALPSGlidePoint::alps_rpt_cmd(SInt32 init_command, SInt32 init_arg, SInt32 repeated_command, ALPSStatus_t *report) {
@@ -2994,6 +3220,72 @@ bool ApplePS2ALPSGlidePoint::matchTable(ALPSStatus_t *e7, ALPSStatus_t *ec) {
 }
 
 IOReturn ApplePS2ALPSGlidePoint::identify() {
+    ALPSStatus_t e7, ec;
+    uint64_t start_abs, end_abs;
+
+    // The V8 wake workaround in setDevicePowerState relies on the full
+    // identify sequence, which is what makes V8 work again after sleep.
+    // The cached path was never tested on V8 hardware, so V8 always
+    // takes the full path.
+    if (_profile.valid && _profile.priv.proto_version != ALPS_PROTO_V8 && alps_identify_cached())
+        return 0;
+
+    clock_get_uptime(&start_abs);
+    IOReturn ret = alps_identify(&e7, &ec);
+    clock_get_uptime(&end_abs);
+    absolutetime_to_nanoseconds(end_abs - start_abs, &_identifyFullTime);
+    setProperty("Identify Time (us)", _identifyFullTime / 1000, 32);
+
+    _profile.valid = (ret == 0);
+    if (_profile.valid) {
+        _profile.e7 = e7;
+        _profile.ec = ec;
+        _profile.priv = priv;
+        _profile.init = hw_init;
+        _profile.decode = decode_fields;
+        _profile.process = process_packet;
+    }
+    return ret;
+}
+
+/*
+ * Only ask for the E7/EC reports and compare them with the cached profile.
+ * This skips the E6 report, the trackstick probe and the OTP/device area
+ * reads, which are all nibble command sequences.
+ */
+bool ApplePS2ALPSGlidePoint::alps_identify_cached() {
+    ALPSStatus_t e7, ec;
+    uint64_t start_abs, end_abs;
+
+    clock_get_uptime(&start_abs);
+    bool match = alps_rpt_cmd(kDP_SetMouseResolution, NULL, kDP_SetMouseScaling2To1, &e7) &&
+                 alps_rpt_cmd(kDP_SetMouseResolution, NULL, kDP_MouseResetWrap, &ec) &&
+                 alps_exit_command_mode() &&
+                 !memcmp(e7.bytes, _profile.e7.bytes, sizeof(e7.bytes)) &&
+                 !memcmp(ec.bytes, _profile.ec.bytes, sizeof(ec.bytes));
+    clock_get_uptime(&end_abs);
+    absolutetime_to_nanoseconds(end_abs - start_abs, &_identifyCachedTime);
+
+    if (!match) {
+        IOLog("%s: identify: signature changed (E7=0x%02x 0x%02x 0x%02x, EC=0x%02x 0x%02x 0x%02x), doing full identify\n",
+              getName(), e7.bytes[0], e7.bytes[1], e7.bytes[2], ec.bytes[0], ec.bytes[1], ec.bytes[2]);
+        _profile.valid = false;
+        return false;
+    }
+
+    priv = _profile.priv;
+    hw_init = _profile.init;
+    decode_fields = _profile.decode;
+    process_packet = _profile.process;
+    set_resolution();
+
+    setProperty("Cached Identify Time (us)", _identifyCachedTime / 1000, 32);
+    DEBUG_LOG("%s: identify: cached profile confirmed in %llu us (full identify took %llu us)\n",
+              getName(), _identifyCachedTime / 1000, _identifyFullTime / 1000);
+    return true;
+}
+
+IOReturn ApplePS2ALPSGlidePoint::alps_identify(ALPSStatus_t *e7_out, ALPSStatus_t *ec_out) {
     ALPSStatus_t e6, e7, ec;
 
     /*
@@ -3024,6 +3316,9 @@ IOReturn ApplePS2ALPSGlidePoint::identify() {
         return kIOReturnIOError;
     }
 
+    *e7_out = e7;
+    *ec_out = ec;
+
     if (matchTable(&e7, &ec)) {
         return 0;
 
@@ -3128,7 +3423,7 @@ int ApplePS2ALPSGlidePoint::abs(int x) {
 
 void ApplePS2ALPSGlidePoint::set_resolution() {
     physical_max_x = priv.x_max * 4; // this number was determined experimentally
-    physical_max_y = priv.y_max * 4.5; // this number was determined experimentally
+    physical_max_y = priv.y_max * 9 / 2; // this number was determined experimentally
 
     logical_max_x = priv.x_max;
     logical_max_y = priv.y_max;
@@ -3155,30 +3450,63 @@ void ApplePS2ALPSGlidePoint::set_resolution() {
               xupmm, yupmm);
 }
 
-void ApplePS2ALPSGlidePoint::voodooTrackpoint(UInt32 type, SInt8 x, SInt8 y, int buttons) {
+void ApplePS2ALPSGlidePoint::voodooTrackpoint(UInt32 type, int x, int y, int buttons) {
     AbsoluteTime timestamp;
     clock_get_uptime(&timestamp);
 
     switch (type) {
-        case kIOMessageVoodooTrackpointRelativePointer:
+        case kIOMessageVoodooTrackpointRelativePointer: {
+            int dx = x, dy = y;
+            uint64_t timestamp_ns;
+            absolutetime_to_nanoseconds(timestamp, &timestamp_ns);
+            _trackpointCurve.apply(dx, dy, timestamp_ns, false);
             RelativePointerEvent rpevent;
-            rpevent.dx = x;
-            rpevent.dy = y;
+            rpevent.dx = dx;
+            rpevent.dy = dy;
             rpevent.buttons = buttons;
             rpevent.timestamp = timestamp;
             super::messageClient(kIOMessageVoodooTrackpointRelativePointer, voodooInputInstance, &rpevent, sizeof(rpevent));
             break;
-        case kIOMessageVoodooTrackpointScrollWheel:
+        }
+        case kIOMessageVoodooTrackpointScrollWheel: {
+            int axis1 = -y, axis2 = -x;
+            uint64_t timestamp_ns;
+            absolutetime_to_nanoseconds(timestamp, &timestamp_ns);
+            _scrollEngine.feed(axis1, axis2, timestamp_ns);
+            if (_scrollTimer) {
+                if (int delay = _scrollEngine.momentumDelayMS())
+                    _scrollTimer->setTimeoutMS(delay);
+                else
+                    _scrollTimer->cancelTimeout();
+            }
             ScrollWheelEvent swevent;
-            swevent.deltaAxis1 = -y;
-            swevent.deltaAxis2 = -x;
+            swevent.deltaAxis1 = axis1;
+            swevent.deltaAxis2 = axis2;
             swevent.deltaAxis3 = 0;
             swevent.timestamp = timestamp;
             super::messageClient(kIOMessageVoodooTrackpointScrollWheel, voodooInputInstance, &swevent, sizeof(swevent));
             break;
+        }
     }
 }
 
+void ApplePS2ALPSGlidePoint::onScrollTimer() {
+    int axis1, axis2;
+    bool moving = _scrollEngine.tick(axis1, axis2);
+    if (axis1 || axis2) {
+        AbsoluteTime timestamp;
+        clock_get_uptime(&timestamp);
+        ScrollWheelEvent swevent;
+        swevent.deltaAxis1 = axis1;
+        swevent.deltaAxis2 = axis2;
+        swevent.deltaAxis3 = 0;
+        swevent.timestamp = timestamp;
+        super::messageClient(kIOMessageVoodooTrackpointScrollWheel, voodooInputInstance, &swevent, sizeof(swevent));
+    }
+    if (moving)
+        _scrollTimer->setTimeoutMS(kScrollTickMS);
+}
+
 void ApplePS2ALPSGlidePoint::alps_buttons(struct alps_fields &f) {
     bool prev_left = left;
     bool prev_right = right;
@@ -3315,11 +3643,31 @@ void ApplePS2ALPSGlidePoint::sendTouchData() {
     static_assert(VOODOO_INPUT_MAX_TRANSDUCERS >= MAX_TOUCHES, "VoodooPS2ALPSGlidePoint: Trackpad supports too many fingers\n");
     
     int transducers_count = 0;
+    bool rejectedButton = false;
+    int thumb = -1;
     for (int i = 0; i < MAX_TOUCHES; i++) {
         const auto &state = virtualFingerStates[i];
         if (!state.touch) {
+            _disableZones.release(i);
+            _classifier.release(i);
+            continue;
+        }
+
+        // only finger 0 carries the button, it must not get lost with the finger
+        if (_disableZones.reject(i, state.x, logical_max_y + 1 - state.y, logical_max_x - margin_size_x, logical_max_y, timestamp_ns - keytime)) {
+            rejectedButton |= state.button;
+            continue;
+        }
+
+        // no width on ALPS
+        ContactClass type = _classifier.classify(i, state.x, logical_max_y + 1 - state.y, state.pressure, 0, logical_max_y);
+        if (type == kContactPalm) {
+            rejectedButton |= state.button;
             continue;
         }
+        if (type == kContactThumb) {
+            thumb = transducers_count;
+        }
 
         auto &transducer = inputEvent.transducers[transducers_count];
         
@@ -3365,20 +3713,7 @@ void ApplePS2ALPSGlidePoint::sendTouchData() {
                     break;
                 }
 
-                double value;
-                if (state.pressure >= _forceTouchCustomDownThreshold) {
-                    value = 1.0;
-                } else if (state.pressure <= _forceTouchCustomUpThreshold) {
-                    value = 0.0;
-                } else {
-                    double base = ((double) (state.pressure - _forceTouchCustomUpThreshold)) / ((double) (_forceTouchCustomDownThreshold - _forceTouchCustomUpThreshold));
-                    value = 1;
-                    for (int i = 0; i < _forceTouchCustomPower; ++i) {
-                        value *= base;
-                    }
-                }
-
-                transducer.currentCoordinates.pressure = (int) (value * 255);
+                transducer.currentCoordinates.pressure = _forceTouchCurve.map(state.pressure);
                 break;
 
             case FORCE_TOUCH_DISABLED:
@@ -3391,6 +3726,11 @@ void ApplePS2ALPSGlidePoint::sendTouchData() {
 
         transducers_count++;
     }
+
+    if (_disableZones.changed())
+        _disableZones.publish(this, "DisableZoneRejections");
+    if (_classifier.changed())
+        setProperty("Palms Rejected", _classifier.palms(), 32);
     
     // set the thumb to improve 4F pinch and spread gesture and cross-screen dragging
     if (transducers_count >= 4) {
@@ -3412,6 +3752,9 @@ void ApplePS2ALPSGlidePoint::sendTouchData() {
         inputEvent.transducers[newThumbIndex].fingerType = kMT2FingerTypeThumb;
     }
 
+    ContactClassifier::markThumb(inputEvent, transducers_count, thumb);
+    ContactClassifier::keepRejectedButton(inputEvent, transducers_count, rejectedButton, _forceTouchMode == FORCE_TOUCH_BUTTON);
+
     inputEvent.contact_count = transducers_count;
     inputEvent.timestamp = timestamp;
 
@@ -3430,8 +3773,14 @@ void ApplePS2ALPSGlidePoint::initTouchPad() {
     // stale packet fragments.
     //
 
+    if (_interleavedTimer)
+        _interleavedTimer->cancelTimeout();
+    if (_scrollTimer)
+        _scrollTimer->cancelTimeout();
+    _scrollEngine.stop();
     _packetByteCount = 0;
     _ringBuffer.reset();
+    _trackstickRingBuffer.reset();
 
     // clear state of control key cache
     _modifierdown = 0;
@@ -3476,6 +3825,30 @@ void ApplePS2ALPSGlidePoint::setParamPropertiesGated(OSDictionary * config) {
 
     OSBoolean *bl;
     OSNumber *num;
+    OSArray *zones;
+    if ((zones = OSDynamicCast(OSArray, config->getObject("DisableZones"))))
+    {
+        _disableZones.load(zones);
+        setProperty("DisableZones", zones);
+    }
+    OSDictionary *palm;
+    if ((palm = OSDynamicCast(OSDictionary, config->getObject("PalmClassifier"))))
+    {
+        _classifier.load(palm);
+        setProperty("PalmClassifier", palm);
+    }
+    OSDictionary *curve;
+    if ((curve = OSDynamicCast(OSDictionary, config->getObject("TrackpointCurve"))))
+    {
+        _trackpointCurve.load(curve);
+        setProperty("TrackpointCurve", curve);
+    }
+    OSDictionary *scroll;
+    if ((scroll = OSDynamicCast(OSDictionary, config->getObject("SmoothScroll"))))
+    {
+        _scrollEngine.load(scroll);
+        setProperty("SmoothScroll", scroll);
+    }
     // 64-bit config items
     for (int i = 0; i < countof(int64vars); i++)
         if ((num=OSDynamicCast(OSNumber, config->getObject(int64vars[i].name))))
@@ -3527,6 +3900,8 @@ void ApplePS2ALPSGlidePoint::setParamPropertiesGated(OSDictionary * config) {
             PE_parse_boot_argn("auth-root-dmg", val, sizeof(val)))
             _forceTouchMode = FORCE_TOUCH_DISABLED;
     }
+
+    _forceTouchCurve.build(_forceTouchCustomUpThreshold, _forceTouchCustomDownThreshold, _forceTouchCustomPower);
 }
 
 IOReturn ApplePS2ALPSGlidePoint::setProperties(OSObject *props) {
@@ -3551,6 +3926,7 @@ void ApplePS2ALPSGlidePoint::setDevicePowerState( UInt32 whatToDo ) {
             //
 
             setTouchPadEnable( false );
+            publishPacketStats();
             break;
 
         case kPS2C_EnableDevice:
@@ -3618,6 +3994,8 @@ IOReturn ApplePS2ALPSGlidePoint::message(UInt32 type, IOService* provider, void*
                 _device->lock();
                 resetMouse();
                 IOSleep(wakedelay);
+                // explicit reset, don't trust the cached profile
+                _profile.valid = false;
                 identify();
                 initTouchPad();
                 _device->unlock();
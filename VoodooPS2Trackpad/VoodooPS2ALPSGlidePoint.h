@@ -315,9 +315,12 @@ struct alps_data {
     UInt8 multi_data[6];
     struct alps_fields f;
     UInt8 quirks;
-    bool PSMOUSE_BAD_DATA;
 
     int pktsize = 6;
+
+    /* per byte framing check, built by alps_setup_packet_checks() */
+    UInt8 byte_mask[8];
+    UInt8 byte_value[8];
 };
 
 // Pulled out of alps_data, now saved as vars on class
@@ -338,6 +341,19 @@ typedef struct ALPSStatus {
     UInt8 bytes[3];
 } ALPSStatus_t;
 
+/*
+ * Result of a full identify(), including OTP/device area reads done by
+ * set_protocol(). Reused on wake while the E7/EC reports still match.
+ */
+struct alps_profile {
+    bool valid;
+    ALPSStatus_t e7, ec;
+    struct alps_data priv;
+    hw_init init;
+    decode_fields decode;
+    process_packet process;
+};
+
 #define XMIN 0
 #define XMAX 6143
 #define YMIN 0
@@ -352,6 +368,7 @@ typedef struct ALPSStatus {
 #define Y_MAX_POSITIVE 8176
 
 #define kPacketLength 6
+#define kPacketLengthSmall 3
 #define kDP_CommandNibble10 0xf2
 
 // predeclure stuff
@@ -368,6 +385,18 @@ private:
     RingBuffer<UInt8, kPacketLength*32> _ringBuffer {};
     UInt32              _packetByteCount {0};
 
+    // PS/2 trackstick packets found in the touchpad stream, see interruptOccurred
+    RingBuffer<UInt8, kPacketLengthSmall*32> _trackstickRingBuffer {};
+    IOTimerEventSource* _interleavedTimer {nullptr};
+    IOSimpleLock*       _packetLock {nullptr};      // serializes the flush timer with byte delivery
+    UInt32              _heldPackets {0};           // bumped each time a packet is held back
+    UInt32              _heldPacketsArmed {0};      // _heldPackets the flush timer was armed for
+    IOTimerEventSource* _scrollTimer {nullptr};
+    UInt32              _barePS2Packets {0};
+    UInt32              _interleavedPS2Packets {0};
+    UInt32              _droppedPackets {0};
+    UInt32              _droppedPacketsLogged {0};
+
     IOCommandGate*      _cmdGate {nullptr};
 
     VoodooInputEvent inputEvent {};
@@ -386,6 +415,11 @@ private:
     uint32_t logical_max_x {0};
     uint32_t logical_max_y {0};
 
+    DisableZoneMap _disableZones {};
+    ContactClassifier _classifier {kContactClassifierDefaults};
+    TrackpointCurve _trackpointCurve {};
+    ScrollEngine _scrollEngine {};
+
     uint32_t physical_max_x {0};
     uint32_t physical_max_y {0};
 
@@ -403,6 +437,7 @@ private:
     int _forceTouchCustomDownThreshold {90};
     int _forceTouchCustomUpThreshold {20};
     int _forceTouchCustomPower {8};
+    ForceTouchCurve _forceTouchCurve {};
 
     // normal state
     UInt32 lastbuttons {0};
@@ -437,14 +472,27 @@ private:
     process_packet process_packet;
     //    set_abs_params set_abs_params;
 
+    alps_profile _profile {};
+    uint64_t _identifyFullTime {0};     // ns, last full identify
+    uint64_t _identifyCachedTime {0};   // ns, last signature check against _profile
+
     void injectVersionDependentProperties(OSDictionary* dict);
     bool resetMouse();
     bool handleOpen(IOService *forClient, IOOptionBits options, void *arg) override;
     void handleClose(IOService *forClient, IOOptionBits options) override;
     bool handleIsOpen(const IOService *forClient) const override;
     PS2InterruptResult interruptOccurred(UInt8 data);
+    PS2InterruptResult alps_process_byte(UInt8 data);
     void packetReady();
+    PS2InterruptResult alps_handle_interleaved_ps2(UInt8 *packet, UInt8 data);
+    PS2InterruptResult alps_drop_packet();
+    void alps_queue_bare_ps2_packet(const UInt8 *packet);
+    void alps_report_bare_ps2_packet(const UInt8 *packet);
+    void onInterleavedTimer();
+    void onScrollTimer();
+    void publishPacketStats();
     virtual bool deviceSpecificInit();
+    void alps_setup_packet_checks();
 
     void alps_process_packet_v1_v2(UInt8 *packet);
     int alps_process_bitmap(struct alps_data *priv, struct alps_fields *f);
@@ -467,6 +515,8 @@ private:
     unsigned char alps_get_pkt_id_ss4_v2(UInt8 *byte);
     bool alps_decode_ss4_v2(struct alps_fields *f, UInt8 *p);
     void alps_process_packet_ss4_v2(UInt8 *packet);
+    bool alps_append_nibble(PS2Request *request, int &cmd, int nibble);
+    bool alps_append_set_addr(PS2Request *request, int &cmd, int addr);
     bool alps_command_mode_send_nibble(int value);
     bool alps_command_mode_set_addr(int addr);
     int alps_command_mode_read_reg(int addr);
@@ -506,12 +556,14 @@ private:
     void set_protocol();
     bool matchTable(ALPSStatus_t *e7, ALPSStatus_t *ec);
     IOReturn identify();
+    IOReturn alps_identify(ALPSStatus_t *e7, ALPSStatus_t *ec);
+    bool alps_identify_cached();
     void setTouchPadEnable(bool enable);
     void ps2_command(unsigned char value, UInt8 command);
     void ps2_command_short(UInt8 command);
     int abs(int x);
     void set_resolution();
-    void voodooTrackpoint(UInt32 type, SInt8 x, SInt8 y, int buttons);
+    void voodooTrackpoint(UInt32 type, int x, int y, int buttons);
     void alps_buttons(struct alps_fields &f);
 
     void prepareVoodooInput(struct alps_fields &f, int fingers);
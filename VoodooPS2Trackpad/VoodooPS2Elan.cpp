@@ -236,7 +236,10 @@ bool ApplePS2Elan::start(IOService *provider) {
     // Setup workloop with command gate for thread syncronization...
     IOWorkLoop *pWorkLoop = getWorkLoop();
     _cmdGate = IOCommandGate::commandGate(this);
-    if (!pWorkLoop || !_cmdGate) {
+    _frameTimer = IOTimerEventSource::timerEventSource(this, OSMemberFunctionCast(IOTimerEventSource::Action, this, &ApplePS2Elan::onFrameTimer));
+    if (!pWorkLoop || !_cmdGate || !_frameTimer) {
+        OSSafeReleaseNULL(_cmdGate);
+        OSSafeReleaseNULL(_frameTimer);
         OSSafeReleaseNULL(_device);
         return false;
     }
@@ -248,6 +251,7 @@ bool ApplePS2Elan::start(IOService *provider) {
     registerHIDPointerNotifications();
 
     pWorkLoop->addEventSource(_cmdGate);
+    pWorkLoop->addEventSource(_frameTimer);
 
     elantechSetupPS2();
 
@@ -303,6 +307,14 @@ void ApplePS2Elan::stop(IOService *provider) {
         _interruptHandlerInstalled = false;
     }
 
+    // Release the frame timer, nothing arms it once packets stop
+    if (_frameTimer) {
+        _frameTimer->cancelTimeout();
+        if (pWorkLoop)
+            pWorkLoop->removeEventSource(_frameTimer);
+        OSSafeReleaseNULL(_frameTimer);
+    }
+
     // Uninstall the power control handler
     if (_powerControlHandlerInstalled) {
         _device->uninstallPowerControlAction();
@@ -329,7 +341,7 @@ void ApplePS2Elan::setParamPropertiesGated(OSDictionary *config) {
         {"TrackpointDividerY",                 &_trackpointDividerY},
         {"TrackpointScrollMultiplierX",        &_trackpointScrollMultiplierX},
         {"TrackpointScrollMultiplierY",        &_trackpointScrollMultiplierY},
-        {"TrackpointScrollDividerY",           &_trackpointScrollDividerX},
+        {"TrackpointScrollDividerX",           &_trackpointScrollDividerX},
         {"TrackpointScrollDividerY",           &_trackpointScrollDividerY},
         {"MouseResolution",                    &_mouseResolution},
         {"MouseSampleRate",                    &_mouseSampleRate},
@@ -352,6 +364,24 @@ void ApplePS2Elan::setParamPropertiesGated(OSDictionary *config) {
 
     OSBoolean *bl;
     OSNumber *num;
+    OSArray *zones;
+    OSDictionary *palm;
+
+    if ((zones = OSDynamicCast(OSArray, config->getObject("DisableZones")))) {
+        disableZones.load(zones);
+        setProperty("DisableZones", zones);
+    }
+
+    if ((palm = OSDynamicCast(OSDictionary, config->getObject("PalmClassifier")))) {
+        classifier.load(palm);
+        setProperty("PalmClassifier", palm);
+    }
+
+    OSDictionary *curve;
+    if ((curve = OSDynamicCast(OSDictionary, config->getObject("TrackpointCurve")))) {
+        trackpointCurve.load(curve);
+        setProperty("TrackpointCurve", curve);
+    }
 
     // highrate?
     if ((bl = OSDynamicCast(OSBoolean, config->getObject("UseHighRate")))) {
@@ -366,6 +396,13 @@ void ApplePS2Elan::setParamPropertiesGated(OSDictionary *config) {
         }
     }
 
+    // TrackpointScrollDividerY used to set both axes, keep that for configs without X
+    if (!config->getObject("TrackpointScrollDividerX") &&
+        OSDynamicCast(OSNumber, config->getObject("TrackpointScrollDividerY"))) {
+        _trackpointScrollDividerX = _trackpointScrollDividerY;
+        setProperty("TrackpointScrollDividerX", _trackpointScrollDividerX, 32);
+    }
+
     // 64-bit config items
     for (int i = 0; i < countof(int64vars); i++) {
         if ((num = OSDynamicCast(OSNumber, config->getObject(int64vars[i].name)))) {
@@ -494,6 +531,7 @@ void ApplePS2Elan::setDevicePowerState(UInt32 whatToDo) {
         case kPS2C_DisableDevice:
             // Disable the touchpad
             setTouchPadEnable(false);
+            publishFrameStats();
             break;
 
         case kPS2C_EnableDevice:
@@ -504,10 +542,10 @@ void ApplePS2Elan::setDevicePowerState(UInt32 whatToDo) {
             // Clear packet buffer pointer to avoid issues caused by stale packet fragments
             _packetByteCount = 0;
             _ringBuffer.reset();
+            frameFingersMask = 0;
 
             // Reset and enable the touchpad
-            resetMouse();
-            elantechSetupPS2();
+            elantechResumePS2();
             setTouchPadEnable(true);
             break;
     }
@@ -668,17 +706,20 @@ int ApplePS2Elan::ps2_command(UInt8 *params, unsigned int command) {
 template<int I>
 int ApplePS2Elan::elantech_ps2_command(unsigned char *param, int command) {
     int rc;
-    int tries = ETP_PS2_COMMAND_TRIES;
+    unsigned int waited = 0;
+    unsigned int delay = commandRetry.learnedDelay;
+    uint64_t start_abs;
+    clock_get_uptime(&start_abs);
 
-    do {
-        rc = ps2_command<I>(param, command);
-        if (rc == 0) {
-            break;
-        }
-        tries--;
-        DEBUG_LOG("VoodooPS2Elan: retrying ps2 command 0x%02x (%d).\n", command, tries);
-        IOSleep(ETP_PS2_COMMAND_DELAY);
-    } while (tries > 0);
+    while ((rc = ps2_command<I>(param, command)) != 0 && !commandRetry.expired(start_abs)) {
+        commandRetry.retries++;
+        DEBUG_LOG("VoodooPS2Elan: retrying ps2 command 0x%02x in %u ms.\n", command, delay);
+        IOSleep(delay);
+        waited += delay;
+        delay = commandRetry.nextDelay(delay);
+    }
+
+    commandRetry.finished(rc == 0, waited);
 
     if (rc) {
         DEBUG_LOG("VoodooPS2Elan: ps2 command 0x%02x failed.\n", command);
@@ -1068,7 +1109,9 @@ int ApplePS2Elan::elantechSetInputParams() {
  */
 int ApplePS2Elan::elantechSetAbsoluteMode() {
     unsigned char val;
-    int tries = ETP_READ_BACK_TRIES;
+    unsigned int waited = 0;
+    unsigned int delay = readBackRetry.learnedDelay;
+    uint64_t start_abs;
     int rc = 0;
 
     switch (info.hw_version) {
@@ -1120,15 +1163,16 @@ int ApplePS2Elan::elantechSetAbsoluteMode() {
         // sure the absolute mode bit is set. For hardware version 2
         // the touchpad is probably initializing and not ready until
         // we read back the value we just wrote.
-        do {
-            rc = elantechReadReg(0x10, &val);
-            if (rc == 0) {
-                break;
-            }
-            tries--;
-            DEBUG_LOG("VoodooPS2Elan: retrying read (%d).\n", tries);
-            IOSleep(ETP_READ_BACK_DELAY);
-        } while (tries > 0);
+        clock_get_uptime(&start_abs);
+        while ((rc = elantechReadReg(0x10, &val)) != 0 && !readBackRetry.expired(start_abs)) {
+            readBackRetry.retries++;
+            DEBUG_LOG("VoodooPS2Elan: retrying read in %u ms.\n", delay);
+            IOSleep(delay);
+            waited += delay;
+            delay = readBackRetry.nextDelay(delay);
+        }
+
+        readBackRetry.finished(rc == 0, waited);
 
         if (rc) {
             DEBUG_LOG("VoodooPS2Elan: failed to read back register 0x10.\n");
@@ -1150,9 +1194,7 @@ skip_readback_reg_10:
  * Initialize the touchpad
  */
 int ApplePS2Elan::elantechSetupPS2() {
-    etd.parity[0] = 1;
-    for (int i = 1; i < 256; i++)
-        etd.parity[i] = etd.parity[i & (i - 1)] ^ 1;
+    elantechSetupPacketChecks();
 
     if (elantechSetAbsoluteMode()) {
         DEBUG_LOG("VoodooPS2: failed to put touchpad into absolute mode.\n");
@@ -1166,9 +1208,13 @@ int ApplePS2Elan::elantechSetupPS2() {
     }
      */
 
-    if (elantechSetInputParams()) {
-        DEBUG_LOG("VoodooPS2: failed to query touchpad range.\n");
-        return -1;
+    // input parameters only change with a new elantechQueryInfo()
+    if (!inputParamsPublished) {
+        if (elantechSetInputParams()) {
+            DEBUG_LOG("VoodooPS2: failed to query touchpad range.\n");
+            return -1;
+        }
+        inputParamsPublished = true;
     }
 
     // set resolution and dpi
@@ -1190,9 +1236,52 @@ int ApplePS2Elan::elantechSetupPS2() {
     request.commandsCount = 7;
     _device->submitRequestAndBlock(&request);
 
+    publishRetryStats();
+
     return 0;
 }
 
+/*
+ * Wake counterpart of elantechSetupPS2(). The device info from start is
+ * kept, the firmware version and capabilities are only read back to make
+ * sure it is still the same touchpad. On mismatch the touchpad is detected
+ * and queried again as on start.
+ */
+int ApplePS2Elan::elantechResumePS2() {
+    unsigned char fw[3], caps[3];
+    uint64_t start_abs, end_abs, wake_ns;
+    int rc;
+
+    clock_get_uptime(&start_abs);
+    resetMouse();
+
+    bool same = synaptics_send_cmd<3>(ETP_FW_VERSION_QUERY, fw) == 0 &&
+                send_cmd<3>(ETP_CAPABILITIES_QUERY, caps) == 0 &&
+                ((fw[0] << 16) | (fw[1] << 8) | fw[2]) == info.fw_version &&
+                !memcmp(caps, info.capabilities, sizeof(caps));
+
+    if (!same) {
+        IOLog("VoodooPS2Elan: touchpad signature changed on wake, detecting again\n");
+        resetMouse();
+        if (elantechDetect()) {
+            DEBUG_LOG("VoodooPS2Elan: elan touchpad not detected\n");
+        }
+        resetMouse();
+        if (elantechQueryInfo()) {
+            DEBUG_LOG("VoodooPS2Elan: query info failed\n");
+        }
+        inputParamsPublished = false;
+    }
+
+    rc = elantechSetupPS2();
+
+    clock_get_uptime(&end_abs);
+    absolutetime_to_nanoseconds(end_abs - start_abs, &wake_ns);
+    setProperty(same ? "Wake Time (us)" : "Wake Time Full Detect (us)", wake_ns / 1000, 32);
+
+    return rc;
+}
+
 /*
  * Send an Elantech style special command to read a value from a register
  */
@@ -1319,16 +1408,109 @@ int ApplePS2Elan::elantechWriteReg(unsigned char reg, unsigned char val) {
     return rc;
 }
 
-int ApplePS2Elan::elantechDebounceCheckV2() {
-    // When we encounter packet that matches this exactly, it means the
-    // hardware is in debounce status. Just ignore the whole packet.
-    static const uint8_t debounce_packet[] = {
-        0x84, 0xff, 0xff, 0x02, 0xff, 0xff
-    };
+// Parity lookup for V1 packets, 1 when the byte has an even number of bits set
+struct ElantechParityTable {
+    unsigned char parity[256];
 
-    unsigned char *packet = _ringBuffer.tail();
+    constexpr ElantechParityTable() : parity() {
+        parity[0] = 1;
+        for (int i = 1; i < 256; i++)
+            parity[i] = parity[i & (i - 1)] ^ 1;
+    }
+};
+
+static constexpr ElantechParityTable elantechParity {};
+
+// Place a byte mask/value at offset i of a packet word
+static constexpr UInt64 PB(int i, UInt8 v) {
+    return (UInt64)v << (8 * i);
+}
+
+/*
+ * Pick the constant bit patterns for the detected hardware, so that
+ * elantechPacketCheck() is reduced to a few masked compares per packet.
+ * Patterns are tried in order, the first match gives the packet type.
+ */
+void ApplePS2Elan::elantechSetupPacketChecks() {
+    elantech_packet_pattern *p = packetPatterns;
+    // hardware is in debounce status when the packet matches exactly
+    const UInt64 debounce = PB(1, 0xff) | PB(2, 0xff) | PB(3, 0x02) | PB(4, 0xff) | PB(5, 0xff);
+    const UInt64 all = 0xffffffffffffULL;
+
+    switch (info.hw_version) {
+        case 2:
+            *p++ = { all, PB(0, 0x84) | debounce, PACKET_DEBOUNCE };
+
+            // V2 hardware has two flavors. Older ones that do not report pressure,
+            // and newer ones that reports pressure and width. With newer ones, all
+            // packets (1, 2, 3 finger touch) have the same constant bits. With
+            // older ones, 1/3 finger touch packets and 2 finger touch packets
+            // have different constant bits.
+            // With all three cases, if the constant bits are not exactly what I
+            // expected, I consider them invalid.
+            if (!info.paritycheck) {
+                *p++ = { 0, 0, PACKET_V2 };
+            } else if (info.reports_pressure) {
+                *p++ = { PB(0, 0x0c) | PB(3, 0x0f), PB(0, 0x04) | PB(3, 0x02), PACKET_V2 };
+            } else {
+                // 2 finger packets carry 0x80 in the top bits of byte 0. A
+                // packet passing the second check with those bits also passes
+                // the first, so the order does not matter.
+                *p++ = { PB(0, 0xcc) | PB(3, 0x0e), PB(0, 0x8c) | PB(3, 0x08), PACKET_V2 };
+                *p++ = { PB(0, 0x3c) | PB(1, 0xf0) | PB(3, 0x3e) | PB(4, 0xf0), PB(0, 0x3c) | PB(3, 0x38), PACKET_V2 };
+            }
+            break;
+
+        case 3:
+            // check debounce first, it has the same signature in byte 0
+            // and byte 3 as PACKET_V3_HEAD.
+            *p++ = { all, PB(0, 0xc4) | debounce, PACKET_DEBOUNCE };
+
+            // If the hardware flag 'crc_enabled' is set the packets have different signatures.
+            if (info.crc_enabled) {
+                *p++ = { PB(3, 0x09), PB(3, 0x08), PACKET_V3_HEAD };
+                *p++ = { PB(3, 0x09), PB(3, 0x09), PACKET_V3_TAIL };
+            } else {
+                *p++ = { PB(0, 0x0c) | PB(3, 0xcf), PB(0, 0x04) | PB(3, 0x02), PACKET_V3_HEAD };
+                *p++ = { PB(0, 0x0c) | PB(3, 0xce), PB(0, 0x0c) | PB(3, 0x0c), PACKET_V3_TAIL };
+                *p++ = { PB(3, 0x0f), PB(3, 0x06), PACKET_TRACKPOINT };
+            }
+            break;
+
+        case 4: {
+            if (info.has_trackpoint) {
+                *p++ = { PB(3, 0x0f), PB(3, 0x06), PACKET_TRACKPOINT };
+            }
+
+            // This represents the version of IC body.
+            unsigned int ic_version = (info.fw_version & 0x0f0000) >> 16;
+
+            // Sanity check based on the constant bits of a packet.
+            // The constant bits change depending on the value of
+            // the hardware flag 'crc_enabled' and the version of
+            // the IC body, but are the same for every packet,
+            // regardless of the type, which is in the low bits of byte 3.
+            UInt64 mask, value;
+            if (info.crc_enabled) {
+                mask = PB(3, 0x08);
+                value = 0;
+            } else if (ic_version == 7 && info.samples[1] == 0x2A) {
+                mask = PB(3, 0x1c);
+                value = PB(3, 0x10);
+            } else {
+                mask = PB(0, 0x08) | PB(3, 0x1c);
+                value = PB(3, 0x10);
+            }
 
-    return !memcmp(packet, debounce_packet, sizeof(debounce_packet));
+            *p++ = { mask | PB(3, 0x03), value | PB(3, 0x00), PACKET_V4_STATUS };
+            *p++ = { mask | PB(3, 0x03), value | PB(3, 0x01), PACKET_V4_HEAD };
+            *p++ = { mask | PB(3, 0x03), value | PB(3, 0x02), PACKET_V4_MOTION };
+            break;
+        }
+    }
+
+    packetPatternCount = (int)(p - packetPatterns);
+    assert(packetPatternCount <= countof(packetPatterns));
 }
 
 int ApplePS2Elan::elantechPacketCheckV1() {
@@ -1348,118 +1530,23 @@ int ApplePS2Elan::elantechPacketCheckV1() {
 
     p3 = (packet[0] & 0x04) >> 2;
 
-    return etd.parity[packet[1]] == p1 &&
-           etd.parity[packet[2]] == p2 &&
-           etd.parity[packet[3]] == p3;
+    return elantechParity.parity[packet[1]] == p1 &&
+           elantechParity.parity[packet[2]] == p2 &&
+           elantechParity.parity[packet[3]] == p3;
 }
 
-int ApplePS2Elan::elantechPacketCheckV2() {
+int ApplePS2Elan::elantechPacketCheck() {
     unsigned char *packet = _ringBuffer.tail();
-
-    // V2 hardware has two flavors. Older ones that do not report pressure,
-    // and newer ones that reports pressure and width. With newer ones, all
-    // packets (1, 2, 3 finger touch) have the same constant bits. With
-    // older ones, 1/3 finger touch packets and 2 finger touch packets
-    // have different constant bits.
-    // With all three cases, if the constant bits are not exactly what I
-    // expected, I consider them invalid.
-
-    if (info.reports_pressure) {
-        return (packet[0] & 0x0c) == 0x04 && (packet[3] & 0x0f) == 0x02;
-    }
-
-    if ((packet[0] & 0xc0) == 0x80) {
-        return (packet[0] & 0x0c) == 0x0c && (packet[3] & 0x0e) == 0x08;
-    }
-
-    return (packet[0] & 0x3c) == 0x3c &&
-           (packet[1] & 0xf0) == 0x00 &&
-           (packet[3] & 0x3e) == 0x38 &&
-           (packet[4] & 0xf0) == 0x00;
-}
-
-int ApplePS2Elan::elantechPacketCheckV3() {
-    static const uint8_t debounce_packet[] = {
-        0xc4, 0xff, 0xff, 0x02, 0xff, 0xff
-    };
-
-    unsigned char *packet = _ringBuffer.tail();
-
-    // check debounce first, it has the same signature in byte 0
-    // and byte 3 as PACKET_V3_HEAD.
-    if (!memcmp(packet, debounce_packet, sizeof(debounce_packet))) {
-        return PACKET_DEBOUNCE;
-    }
-
-    // If the hardware flag 'crc_enabled' is set the packets have different signatures.
-    if (info.crc_enabled) {
-        if ((packet[3] & 0x09) == 0x08) {
-            return PACKET_V3_HEAD;
-        }
-
-        if ((packet[3] & 0x09) == 0x09) {
-            return PACKET_V3_TAIL;
-        }
-    } else {
-        if ((packet[0] & 0x0c) == 0x04 && (packet[3] & 0xcf) == 0x02) {
-            return PACKET_V3_HEAD;
-        }
-
-        if ((packet[0] & 0x0c) == 0x0c && (packet[3] & 0xce) == 0x0c) {
-            return PACKET_V3_TAIL;
-        }
-
-        if ((packet[3] & 0x0f) == 0x06) {
-            return PACKET_TRACKPOINT;
-        }
-    }
-
-    return PACKET_UNKNOWN;
-}
-
-int ApplePS2Elan::elantechPacketCheckV4() {
-    unsigned char *packet = _ringBuffer.tail();
-    unsigned char packet_type = packet[3] & 0x03;
-    unsigned int ic_version;
-    bool sanity_check;
+    UInt64 word = 0;
 
     INTERRUPT_LOG("VoodooPS2Elan: Packet dump (%04x, %04x, %04x, %04x, %04x, %04x)\n", packet[0], packet[1], packet[2], packet[3], packet[4], packet[5]);
 
-    if (info.has_trackpoint && (packet[3] & 0x0f) == 0x06) {
-        return PACKET_TRACKPOINT;
-    }
-
-    // This represents the version of IC body.
-    ic_version = (info.fw_version & 0x0f0000) >> 16;
-
-    INTERRUPT_LOG("VoodooPS2Elan: icVersion(%d), crc(%d), samples[1](%d) \n", ic_version, info.crc_enabled, info.samples[1]);
+    memcpy(&word, packet, _packetLength);
 
-    // Sanity check based on the constant bits of a packet.
-    // The constant bits change depending on the value of
-    // the hardware flag 'crc_enabled' and the version of
-    // the IC body, but are the same for every packet,
-    // regardless of the type.
-    if (info.crc_enabled) {
-        sanity_check = ((packet[3] & 0x08) == 0x00);
-    } else if (ic_version == 7 && info.samples[1] == 0x2A) {
-        sanity_check = ((packet[3] & 0x1c) == 0x10);
-    } else {
-        sanity_check = ((packet[0] & 0x08) == 0x00 && (packet[3] & 0x1c) == 0x10);
-    }
-
-    if (!sanity_check) {
-        return PACKET_UNKNOWN;
-    }
-
-    switch (packet_type) {
-        case 0:
-            return PACKET_V4_STATUS;
-
-        case 1:
-            return PACKET_V4_HEAD;
-
-        case 2:
-            return PACKET_V4_MOTION;
+    for (int i = 0; i < packetPatternCount; i++) {
+        if ((word & packetPatterns[i].mask) == packetPatterns[i].value) {
+            return packetPatterns[i].type;
+        }
     }
 
     return PACKET_UNKNOWN;
@@ -1550,9 +1637,9 @@ void ApplePS2Elan::elantechReportAbsoluteV1() {
         virtualFinger[0].prev = virtualFinger[0].now;
         virtualFinger[1].prev = virtualFinger[1].now;
 
-        int h = 100;
-        int dy = (int)(sin30deg * h);
-        int dx = (int)(cos30deg * h);
+        const int h = kFakeFingerRadius;
+        const int dy = kFakeFingerDY;
+        const int dx = kFakeFingerDX;
 
         virtualFinger[0].now.x = x;
         virtualFinger[0].now.y = y - h;
@@ -1573,9 +1660,9 @@ void ApplePS2Elan::elantechReportAbsoluteV1() {
         virtualFinger[1].prev = virtualFinger[1].now;
         virtualFinger[2].prev = virtualFinger[2].now;
 
-        int h = 100;
-        int dy = (int)(sin30deg * h);
-        int dx = (int)(cos30deg * h);
+        const int h = kFakeFingerRadius;
+        const int dy = kFakeFingerDY;
+        const int dx = kFakeFingerDX;
 
         virtualFinger[0].now.x = x;
         virtualFinger[0].now.y = y - h;
@@ -1675,9 +1762,9 @@ void ApplePS2Elan::elantechReportAbsoluteV2() {
         virtualFinger[1].prev = virtualFinger[1].now;
         virtualFinger[2].prev = virtualFinger[2].now;
 
-        int h = 100;
-        int dy = (int)(sin30deg * h);
-        int dx = (int)(cos30deg * h);
+        const int h = kFakeFingerRadius;
+        const int dy = kFakeFingerDY;
+        const int dx = kFakeFingerDX;
 
         virtualFinger[0].now.x = x1;
         virtualFinger[0].now.y = y1 - h;
@@ -1788,9 +1875,9 @@ void ApplePS2Elan::elantechReportAbsoluteV3(int packetType) {
         virtualFinger[1].prev = virtualFinger[1].now;
         virtualFinger[2].prev = virtualFinger[2].now;
 
-        int h = 100;
-        int dy = (int)(sin30deg * h);
-        int dx = (int)(cos30deg * h);
+        const int h = kFakeFingerRadius;
+        const int dy = kFakeFingerDY;
+        const int dx = kFakeFingerDX;
 
         virtualFinger[0].now.x = x1;
         virtualFinger[0].now.y = y1 - h;
@@ -1878,6 +1965,8 @@ void ApplePS2Elan::elantechReportTrackpoint() {
     uint64_t timestamp_ns;
     absolutetime_to_nanoseconds(timestamp, &timestamp_ns);
     keytime = timestamp_ns;
+
+    trackpointCurve.apply(dx, dy, timestamp_ns, trackpointMiddleButton);
     
     trackpointReport.timestamp = timestamp;
     trackpointReport.buttons = trackpointLeftButton | trackpointMiddleButton | trackpointRightButton;
@@ -1890,11 +1979,19 @@ void ApplePS2Elan::elantechReportTrackpoint() {
 void ApplePS2Elan::processPacketStatusV4() {
     unsigned char *packet = _ringBuffer.tail();
     unsigned fingers;
+
+    // finish the frame in progress before the finger set changes
+    if (frameFingersMask != 0) {
+        framesPartial++;
+        sendFrameV4();
+    }
+
     leftButton = packet[0] & 0x1;
     rightButton = packet[0] & 0x2;
 
     // notify finger state change
     fingers = packet[1] & 0x1f;
+    heldFingersMask = fingers;
     int count = 0;
     for (int i = 0; i < ETP_MAX_FINGERS; i++) {
         if ((fingers & (1 << i)) == 0) {
@@ -1908,14 +2005,10 @@ void ApplePS2Elan::processPacketStatusV4() {
         }
     }
 
-    heldFingers = count;
-
-    headPacketsCount = 0;
-
     // if count > 0, we wait for HEAD packets to report so that we report all fingers at once.
     // if count == 0, we have to report the fact fingers are taken off, because there won't be any HEAD packets
     if (count == 0) {
-        sendTouchData();
+        sendFrameV4();
     }
 }
 
@@ -1928,13 +2021,13 @@ void ApplePS2Elan::processPacketHeadV4() {
     int id = ((packet[3] & 0xe0) >> 5) - 1;
     int pres, traces;
 
-    headPacketsCount++;
-
     if (id < 0) {
         INTERRUPT_LOG("VoodooPS2Elan: invalid id, aborting\n");
         return;
     }
 
+    updateFrameV4(1 << id, false);
+
     int x = ((packet[1] & 0x0f) << 8) | packet[2];
     int y = info.y_max - (((packet[4] & 0x0f) << 8) | packet[5]);
 
@@ -1951,10 +2044,11 @@ void ApplePS2Elan::processPacketHeadV4() {
     virtualFinger[id].now.x = x;
     virtualFinger[id].now.y = y;
 
-    if (headPacketsCount == heldFingers) {
-        headPacketsCount = 0;
-        sendTouchData();
-    }
+    // after a status packet every finger gets a head packet
+    if ((frameFingersMask & heldFingersMask) == heldFingersMask)
+        sendFrameV4();
+    else
+        _frameTimer->setTimeoutMS(ETP_FRAME_TIMEOUT_MS);
 }
 
 void ApplePS2Elan::processPacketMotionV4() {
@@ -1974,6 +2068,8 @@ void ApplePS2Elan::processPacketMotionV4() {
     sid = ((packet[3] & 0xe0) >> 5) - 1;
     weight = (packet[0] & 0x10) ? ETP_WEIGHT_VALUE : 1;
 
+    updateFrameV4((1 << id) | (sid >= 0 ? 1 << sid : 0), true);
+
     // Motion packets give us the delta of x, y values of specific fingers,
     // but in two's complement. Let the compiler do the conversion for us.
     // Also _enlarge_ the numbers to int, in case of overflow.
@@ -1994,9 +2090,72 @@ void ApplePS2Elan::processPacketMotionV4() {
         virtualFinger[sid].now.y -= delta_y2 * weight;
     }
 
+    // only fingers that moved are reported, two per packet: a packet with
+    // one finger is the last one of its frame. After a packet with two the
+    // frame may still go on, if it does not it is sent by the timer.
+    if (sid < 0 || (frameFingersMask & heldFingersMask) == heldFingersMask)
+        sendFrameV4();
+    else
+        _frameTimer->setTimeoutMS(ETP_FRAME_TIMEOUT_MS);
+}
+
+// Head and motion packets of one hardware frame each update one or two
+// fingers. Collect them into a single event. The packet handlers send it
+// when the frame is known to be complete; otherwise it is closed at the
+// next boundary: a switch between head and motion packets, or a finger
+// that is already in the frame. If no packet comes within
+// ETP_FRAME_TIMEOUT_MS, the timer sends the frame as it is, so a frame is
+// never held past one packet time.
+void ApplePS2Elan::updateFrameV4(UInt32 fingersMask, bool motion) {
+    if (frameFingersMask != 0 && (frameMotion != motion || (frameFingersMask & fingersMask))) {
+        // a head frame should cover every announced finger, one that does not lost a packet
+        if (!frameMotion && (frameFingersMask & heldFingersMask) != heldFingersMask)
+            framesTorn++;
+        sendFrameV4();
+    }
+
+    if (frameFingersMask != 0) {
+        framesMerged++;
+    }
+    frameFingersMask |= fingersMask;
+    frameMotion = motion;
+}
+
+void ApplePS2Elan::onFrameTimer() {
+    if (frameFingersMask == 0)
+        return;
+    if (!frameMotion && (frameFingersMask & heldFingersMask) != heldFingersMask)
+        framesTorn++;
+    sendFrameV4();
+}
+
+void ApplePS2Elan::sendFrameV4() {
+    _frameTimer->cancelTimeout();
+    frameFingersMask = 0;
+    framesSent++;
     sendTouchData();
 }
 
+void ApplePS2Elan::publishRetryStats() {
+    setProperty("PS2 Commands", commandRetry.calls, 32);
+    setProperty("PS2 Command Retries", commandRetry.retries, 32);
+    setProperty("PS2 Command Failures", commandRetry.failures, 32);
+    setProperty("PS2 Command Max Wait (ms)", commandRetry.maxWait, 32);
+    setProperty("Read Back Retries", readBackRetry.retries, 32);
+    setProperty("Read Back Failures", readBackRetry.failures, 32);
+    setProperty("Read Back Max Wait (ms)", readBackRetry.maxWait, 32);
+}
+
+void ApplePS2Elan::publishFrameStats() {
+    if (info.hw_version != 4)
+        return;
+
+    setProperty("Frames Sent", framesSent, 32);
+    setProperty("Frames Merged", framesMerged, 32);
+    setProperty("Frames Partial", framesPartial, 32);
+    setProperty("Frames Torn", framesTorn, 32);
+}
+
 MT2FingerType ApplePS2Elan::GetBestFingerType(int i) {
     switch (i) {
         case 0: return kMT2FingerTypeIndexFinger;
@@ -2025,12 +2184,30 @@ void ApplePS2Elan::sendTouchData() {
     static_assert(VOODOO_INPUT_MAX_TRANSDUCERS >= ETP_MAX_FINGERS, "Trackpad supports too many fingers");
 
     int transducers_count = 0;
+    bool rejectedButton = false;
+    int thumb = -1;
     for (int i = 0; i < ETP_MAX_FINGERS; i++) {
         const auto &state = virtualFinger[i];
         if (!state.touch) {
+            disableZones.release(i);
+            classifier.release(i);
+            continue;
+        }
+
+        if (disableZones.reject(i, state.now.x, state.now.y, info.x_max - info.x_min, info.y_max - info.y_min, timestamp_ns - keytime)) {
+            rejectedButton |= info.is_buttonpad && state.button;
             continue;
         }
 
+        ContactClass type = classifier.classify(i, state.now.x, state.now.y, state.pressure, state.width, info.y_max - info.y_min);
+        if (type == kContactPalm) {
+            rejectedButton |= info.is_buttonpad && state.button;
+            continue;
+        }
+        if (type == kContactThumb) {
+            thumb = transducers_count;
+        }
+
         auto &transducer = inputEvent.transducers[transducers_count];
 
         transducer.currentCoordinates = state.now;
@@ -2061,6 +2238,13 @@ void ApplePS2Elan::sendTouchData() {
         transducers_count++;
     }
 
+    if (disableZones.changed()) {
+        disableZones.publish(this, "DisableZoneRejections");
+    }
+    if (classifier.changed()) {
+        setProperty("Palms Rejected", classifier.palms(), 32);
+    }
+
     // set the thumb to improve 4F pinch and spread gesture and cross-screen dragging
     if (transducers_count >= 4) {
         // simple thumb detection: find the lowest finger touch in the vertical direction
@@ -2081,7 +2265,12 @@ void ApplePS2Elan::sendTouchData() {
         inputEvent.transducers[newThumbIndex].fingerType = kMT2FingerTypeThumb;
     }
 
-    for (int i = transducers_count; i < VOODOO_INPUT_MAX_TRANSDUCERS; i++) {
+    ContactClassifier::markThumb(inputEvent, transducers_count, thumb);
+    ContactClassifier::keepRejectedButton(inputEvent, transducers_count, rejectedButton, _forceTouchMode == FORCE_TOUCH_BUTTON);
+
+    // only the entries that were valid in the last sent event need to be invalidated,
+    // everything past that is still invalid from an earlier call
+    for (int i = transducers_count; i < lastSentFingerCount; i++) {
         inputEvent.transducers[i].isValid = false;
         inputEvent.transducers[i].isPhysicalButtonDown = false;
         inputEvent.transducers[i].isTransducerActive = false;
@@ -2090,9 +2279,11 @@ void ApplePS2Elan::sendTouchData() {
     inputEvent.contact_count = transducers_count;
     inputEvent.timestamp = timestamp;
 
-    if (voodooInputInstance) {
+    // send the 0 finger message only once
+    if (voodooInputInstance && (transducers_count != 0 || lastSentFingerCount != 0)) {
         super::messageClient(kIOMessageVoodooInputMessage, voodooInputInstance, &inputEvent, sizeof(VoodooInputEvent));
     }
+    lastSentFingerCount = transducers_count;
 
     if (!info.is_buttonpad) {
         if (transducers_count == 0) {
@@ -2162,12 +2353,14 @@ void ApplePS2Elan::packetReady() {
                 break;
 
             case 2:
-                if (elantechDebounceCheckV2()) {
+                packetType = elantechPacketCheck();
+
+                if (packetType == PACKET_DEBOUNCE) {
                     // ignore debounce
                     break;
                 }
 
-                if (info.paritycheck && !elantechPacketCheckV2()) {
+                if (packetType == PACKET_UNKNOWN) {
                     // ignore invalid packet
                     INTERRUPT_LOG("VoodooPS2Elan: invalid packet received\n");
                     break;
@@ -2178,7 +2371,7 @@ void ApplePS2Elan::packetReady() {
                 break;
 
             case 3:
-                packetType = elantechPacketCheckV3();
+                packetType = elantechPacketCheck();
                 INTERRUPT_LOG("VoodooPS2Elan: Packet Type %d\n", packetType);
 
                 switch (packetType) {
@@ -2203,7 +2396,7 @@ void ApplePS2Elan::packetReady() {
                 break;
 
             case 4:
-                packetType = elantechPacketCheckV4();
+                packetType = elantechPacketCheck();
                 INTERRUPT_LOG("VoodooPS2Elan: Packet Type %d\n", packetType);
 
                 switch (packetType) {
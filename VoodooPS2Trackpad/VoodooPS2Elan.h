@@ -14,6 +14,7 @@
 #include "../VoodooPS2Controller/ApplePS2MouseDevice.h"
 #include <IOKit/hidsystem/IOHIPointing.h>
 #include <IOKit/IOCommandGate.h>
+#include <IOKit/IOTimerEventSource.h>
 #include <IOKit/acpi/IOACPIPlatformDevice.h>
 
 #include "VoodooInputMultitouch/VoodooInputEvent.h"
@@ -68,6 +69,12 @@ struct elan_virtual_finger_state {
 #define ETP_READ_BACK_TRIES           5
 #define ETP_READ_BACK_DELAY           2000
 
+/*
+ * Shortest millisecond delay between tries, see elantech_retry_policy
+ */
+#define ETP_PS2_COMMAND_MIN_DELAY     10
+#define ETP_READ_BACK_MIN_DELAY       50
+
 /*
  * Register bitmasks for hardware version 1
  */
@@ -120,6 +127,7 @@ struct elan_virtual_finger_state {
 #define PACKET_V4_MOTION              0x06
 #define PACKET_V4_STATUS              0x07
 #define PACKET_TRACKPOINT             0x08
+#define PACKET_V2                     0x09
 
 /*
  * track up to 5 fingers for v4 hardware
@@ -131,6 +139,12 @@ struct elan_virtual_finger_state {
  */
 #define ETP_WEIGHT_VALUE              5
 
+/*
+ * v4 frame left open longer than this is sent as it is, a little more
+ * than one 6 byte packet on the wire
+ */
+#define ETP_FRAME_TIMEOUT_MS          8
+
 /*
  * Bus information on 3rd byte of query ETP_RESOLUTION_QUERY(0x04)
  */
@@ -202,7 +216,68 @@ struct elantech_data {
     unsigned char reg_26;
     unsigned int single_finger_reports;
     struct finger_pos mt[ETP_MAX_FINGERS];
-    unsigned char parity[256];
+};
+
+/*
+ * Retry pacing for commands that fail while the touchpad is busy. Instead of
+ * always sleeping the fixed Linux delay, the first retry waits as long as the
+ * last recovery took, then the delay doubles up to maxDelay. Retrying stops
+ * once (tries - 1) * maxDelay has passed since the first try. That is wall
+ * time, so the controller timeouts of failed commands count as well as the
+ * sleeps: slow parts get as long as with the fixed schedule, and a dead
+ * device costs no more.
+ */
+struct elantech_retry_policy {
+    unsigned int minDelay;
+    unsigned int maxDelay;
+    unsigned int budget;
+    unsigned int learnedDelay;
+
+    // statistics
+    UInt32 calls;
+    UInt32 retries;
+    UInt32 failures;
+    UInt32 maxWait;
+
+    constexpr elantech_retry_policy(unsigned int shortest, unsigned int longest, unsigned int tries)
+        : minDelay(shortest), maxDelay(longest), budget((tries - 1) * longest), learnedDelay(shortest),
+          calls(0), retries(0), failures(0), maxWait(0) {}
+
+    bool expired(uint64_t start_abs) const {
+        uint64_t now_abs, elapsed_ns;
+        clock_get_uptime(&now_abs);
+        absolutetime_to_nanoseconds(now_abs - start_abs, &elapsed_ns);
+        return elapsed_ns >= (uint64_t)budget * 1000000;
+    }
+
+    unsigned int nextDelay(unsigned int delay) const {
+        return delay * 2 < maxDelay ? delay * 2 : maxDelay;
+    }
+
+    void finished(bool success, unsigned int waited) {
+        calls++;
+        if (!success) {
+            failures++;
+        } else if (waited == 0) {
+            // relax towards the shortest delay while commands succeed first time
+            learnedDelay = learnedDelay / 2 > minDelay ? learnedDelay / 2 : minDelay;
+        } else {
+            learnedDelay = waited < maxDelay ? waited : maxDelay;
+        }
+        if (waited > maxWait) {
+            maxWait = waited;
+        }
+    }
+};
+
+/*
+ * Constant bits of a packet, compared against the first bytes of the packet
+ * loaded as one little endian word. See elantechSetupPacketChecks().
+ */
+struct elantech_packet_pattern {
+    UInt64 mask;
+    UInt64 value;
+    int type;
 };
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -222,7 +297,16 @@ private:
     UInt32                _packetLength {0};
     RingBuffer<UInt8, kPacketLengthMax * 32> _ringBuffer {};
 
+    bool inputParamsPublished {false};
+
+    elantech_retry_policy commandRetry {ETP_PS2_COMMAND_MIN_DELAY, ETP_PS2_COMMAND_DELAY, ETP_PS2_COMMAND_TRIES};
+    elantech_retry_policy readBackRetry {ETP_READ_BACK_MIN_DELAY, ETP_READ_BACK_DELAY, ETP_READ_BACK_TRIES};
+
+    elantech_packet_pattern packetPatterns[4] {};
+    int packetPatternCount {0};
+
     IOCommandGate*        _cmdGate {nullptr};
+    IOTimerEventSource*   _frameTimer {nullptr};
 
     VoodooInputEvent inputEvent {};
     TrackpointReport trackpointReport {};
@@ -233,12 +317,24 @@ private:
     UInt32 lastLeftButton = 0;
     UInt32 lastRightButton = 0;
 
-    const float sin30deg = 0.5f;
-    const float cos30deg = 0.86602540378f;
+    // Offsets of the emulated fingers for V1-V3 multi-finger reports.
+    // They are spread on a circle of radius 100 at 30 degrees:
+    // dx = cos(30) * 100, dy = sin(30) * 100
+    static constexpr int kFakeFingerRadius = 100;
+    static constexpr int kFakeFingerDX = 86;
+    static constexpr int kFakeFingerDY = 50;
     UInt32 lastFingers = 0;
-
-    int heldFingers = 0;
-    int headPacketsCount = 0;
+    int lastSentFingerCount = 0;
+
+    // V4 frame assembly: fingers announced by the last status packet and
+    // fingers updated by head/motion packets since the last event sent
+    UInt32 heldFingersMask = 0;
+    UInt32 frameFingersMask = 0;
+    bool frameMotion = false;   // frame in progress is made of motion packets
+    UInt32 framesSent = 0;
+    UInt32 framesMerged = 0;    // head/motion packets folded into a frame instead of sent on their own
+    UInt32 framesPartial = 0;   // frames cut short by a status packet
+    UInt32 framesTorn = 0;      // head frames closed before every announced finger reported
     elan_virtual_finger_state virtualFinger[ETP_MAX_FINGERS] {};
 
     static_assert(ETP_MAX_FINGERS <= kMT2FingerTypeLittleFinger, "Too many fingers for one hand");
@@ -270,6 +366,10 @@ private:
     uint64_t keytime {0};
     uint64_t maxaftertyping {500000000};
 
+    DisableZoneMap disableZones {};
+    ContactClassifier classifier {kContactClassifierDefaults};
+    TrackpointCurve trackpointCurve {};
+
     OSSet *attachedHIDPointerDevices {nullptr};
 
     IONotifier *usb_hid_publish_notify {nullptr};          // Notification when an USB mouse HID device is connected
@@ -304,13 +404,12 @@ private:
     int elantechSetAbsoluteMode();
     int elantechSetInputParams();
     int elantechSetupPS2();
+    int elantechResumePS2();
     int elantechReadReg(unsigned char reg, unsigned char *val);
     int elantechWriteReg(unsigned char reg, unsigned char val);
-    int elantechDebounceCheckV2();
+    void elantechSetupPacketChecks();
     int elantechPacketCheckV1();
-    int elantechPacketCheckV2();
-    int elantechPacketCheckV3();
-    int elantechPacketCheckV4();
+    int elantechPacketCheck();
     void elantechRescale(unsigned int x, unsigned int y);
     void elantechReportAbsoluteV1();
     void elantechReportAbsoluteV2();
@@ -320,6 +419,11 @@ private:
     void processPacketStatusV4();
     void processPacketHeadV4();
     void processPacketMotionV4();
+    void updateFrameV4(UInt32 fingersMask, bool motion);
+    void sendFrameV4();
+    void onFrameTimer();
+    void publishFrameStats();
+    void publishRetryStats();
     void sendTouchData();
     void resetMouse();
     void setTouchPadEnable(bool enable);
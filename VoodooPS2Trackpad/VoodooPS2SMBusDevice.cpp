@@ -77,8 +77,8 @@ IOReturn ApplePS2SmbusDevice::resetDevice() {
     request.commandsCount = 1;
     _nub->submitRequestAndBlock(&request);
     
-    if (request.commandsCount == 1) {
-        DEBUG_LOG("VoodooPS2Trackpad: sending $FF failed: %d\n", request.commandsCount);
+    if (request.commandsCount != 1) {
+        DEBUG_LOG("VoodooPS2Trackpad: sending $F5 failed: %d\n", request.commandsCount);
         return kIOReturnError;
     }
     
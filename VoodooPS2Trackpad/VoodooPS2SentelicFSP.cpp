@@ -65,6 +65,7 @@ bool ApplePS2SentelicFSP::init(OSDictionary* dict)
     _packetByteCount           = 0;
     _resolution                = (100) << 16; // (100 dpi, 4 counts/mm)
     _touchPadModeByte          = kModeByteValueGesturesDisabled;
+    _scrollTimer               = 0;
     
     return true;
 }
@@ -268,6 +269,7 @@ ApplePS2SentelicFSP* ApplePS2SentelicFSP::probe( IOService * provider, SInt32 *
             config->release();
             return 0;
         }
+        _scrollEngine.load(OSDynamicCast(OSDictionary, config->getObject("SmoothScroll")));
 #ifdef DEBUG
         // save configuration for later/diagnostics...
         setProperty(kMergedConfiguration, config);
@@ -345,6 +347,18 @@ bool ApplePS2SentelicFSP::start( IOService * provider )
 	
     setProperty(kIOHIDPointerAccelerationTypeKey, kIOHIDTrackpadAccelerationType);
 	
+    //
+    // Setup scroll momentum timer event source
+    //
+    
+    IOWorkLoop* pWorkLoop = getWorkLoop();
+    if (pWorkLoop)
+    {
+        _scrollTimer = IOTimerEventSource::timerEventSource(this, OSMemberFunctionCast(IOTimerEventSource::Action, this, &ApplePS2SentelicFSP::onScrollTimer));
+        if (_scrollTimer)
+            pWorkLoop->addEventSource(_scrollTimer);
+    }
+	
     //
     // Lock the controller during initialization
     //
@@ -412,6 +426,18 @@ void ApplePS2SentelicFSP::stop( IOService * provider )
     if ( _powerControlHandlerInstalled ) _device->uninstallPowerControlAction();
     _powerControlHandlerInstalled = false;
 	
+    //
+    // Release the scroll momentum timer.
+    //
+    
+    if (_scrollTimer)
+    {
+        _scrollTimer->cancelTimeout();
+        if (IOWorkLoop* pWorkLoop = getWorkLoop())
+            pWorkLoop->removeEventSource(_scrollTimer);
+        OSSafeReleaseNULL(_scrollTimer);
+    }
+	
     //
     // Release the pointer to the provider object.
     //
@@ -502,12 +528,42 @@ void ApplePS2SentelicFSP::dispatchRelativePointerEventWithPacket(UInt8* packet,
     if (packetSize == 4)
     {
         dz = (int)(packet[3] & 8) - (int)(packet[3] & 7);
+        if (dz)
+        {
+            int axis2 = 0;
+            uint64_t now_ns;
+            absolutetime_to_nanoseconds(now_abs, &now_ns);
+            _scrollEngine.feed(dz, axis2, now_ns);
+            if (_scrollTimer)
+            {
+                if (int delay = _scrollEngine.momentumDelayMS())
+                    _scrollTimer->setTimeoutMS(delay);
+                else
+                    _scrollTimer->cancelTimeout();
+            }
+        }
         dispatchScrollWheelEventX(dz, 0, 0, now_abs);
     }
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2SentelicFSP::onScrollTimer()
+{
+    int axis1, axis2;
+    bool moving = _scrollEngine.tick(axis1, axis2);
+    if (axis1)
+    {
+        uint64_t now_abs;
+        clock_get_uptime(&now_abs);
+        dispatchScrollWheelEventX(axis1, 0, 0, now_abs);
+    }
+    if (moving)
+        _scrollTimer->setTimeoutMS(kScrollTickMS);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 void ApplePS2SentelicFSP::setTouchPadEnable( bool enable )
 {
     //
@@ -590,6 +646,13 @@ UInt32 ApplePS2SentelicFSP::getTouchPadData( UInt8 dataSelector )
 IOReturn ApplePS2SentelicFSP::setParamProperties( OSDictionary * dict )
 {
     OSNumber * clicking = OSDynamicCast( OSNumber, dict->getObject("Clicking") );
+    OSDictionary * scroll = OSDynamicCast( OSDictionary, dict->getObject("SmoothScroll") );
+	
+    if ( scroll )
+    {
+        _scrollEngine.load(scroll);
+        setProperty("SmoothScroll", scroll);
+    }
 	
     if ( clicking )
     {    
@@ -624,6 +687,9 @@ void ApplePS2SentelicFSP::setDevicePowerState( UInt32 whatToDo )
             // Disable touchpad (synchronous).
             //
 			
+            if (_scrollTimer)
+                _scrollTimer->cancelTimeout();
+            _scrollEngine.stop();
             setTouchPadEnable( false );
             break;
 			
@@ -26,6 +26,7 @@
 #include "../VoodooPS2Controller/ApplePS2MouseDevice.h"
 
 #include <IOKit/hidsystem/IOHIPointing.h>
+#include <IOKit/IOTimerEventSource.h>
 
 #define kPacketLengthMax          4
 #define kPacketLengthStandard     3
@@ -50,6 +51,8 @@ private:
     IOFixed               _resolution;
     UInt16                _touchPadVersion;
     UInt8                 _touchPadModeByte;
+    ScrollEngine          _scrollEngine;
+    IOTimerEventSource *  _scrollTimer;
     
     virtual void   dispatchRelativePointerEventWithPacket( UInt8 * packet, UInt32  packetSize ); 
     
@@ -61,6 +64,7 @@ private:
     virtual PS2InterruptResult interruptOccurred(UInt8 data);
     virtual void packetReady();
     virtual void   setDevicePowerState(UInt32 whatToDo);
+    void           onScrollTimer();
     
 protected:
     IOItemCount buttonCount() override;
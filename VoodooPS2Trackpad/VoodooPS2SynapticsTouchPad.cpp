@@ -169,6 +169,8 @@ IOService* ApplePS2SynapticsTouchPad::probe(IOService * provider, SInt32 * score
       OSSafeReleaseNULL(config);
     }
 
+    uint64_t start_abs, end_abs, probe_ns;
+    clock_get_uptime(&start_abs);
     bool success = getTouchPadData(SYNAPTICS_IDENTIFY_QUERY, reinterpret_cast<uint8_t*>(&_identity));
     if (!success)
     {
@@ -201,6 +203,11 @@ IOService* ApplePS2SynapticsTouchPad::probe(IOService * provider, SInt32 * score
     //
     queryCapabilities();
     
+    clock_get_uptime(&end_abs);
+    absolutetime_to_nanoseconds(end_abs - start_abs, &probe_ns);
+    setProperty("Probe Time (us)", probe_ns / 1000, 32);
+    DEBUG_LOG("VoodooPS2Trackpad: identify and capability queries took %llu us\n", probe_ns / 1000);
+    
     //
     // Attempt to start SMBus Companion. If succesful, attach a stub PS/2 driver.
     //
@@ -221,6 +228,9 @@ IOService* ApplePS2SynapticsTouchPad::probe(IOService * provider, SInt32 * score
         return smbus;
     }
     
+    if (_cont_caps.intertouch)
+        IOLog("VoodooPS2Trackpad: No SMBus companion loaded, using PS/2 for Intertouch capable trackpad\n");
+    
     _device = 0;
 
     DEBUG_LOG("ApplePS2SynapticsTouchPad::probe leaving.\n");
@@ -262,28 +272,36 @@ void ApplePS2SynapticsTouchPad::queryCapabilities()
 {
     synaptics_logic_min_max logic_size;
     synaptics_model model_data;
-    UInt8 *buf;
     
     bzero(&logic_size, sizeof(synaptics_logic_min_max));
     bzero(&model_data, sizeof(synaptics_model));
     
-    // get TouchPad general capabilities
-    buf = reinterpret_cast<UInt8 *>(&_capabilities);
-    if (!getTouchPadData(SYNA_CAPABILITIES_QUERY, buf)) {
+    // Independent queries go out together, see getTouchPadDataBatch.
+    // get TouchPad general capabilities, model and resolution data for scaling x -> y or y -> x depending
+    const UInt8 firstSelectors[] = { SYNA_CAPABILITIES_QUERY, SYNA_MODEL_QUERY, SYNA_SCALE_QUERY };
+    UInt8 *firstBufs[] = { reinterpret_cast<UInt8 *>(&_capabilities), reinterpret_cast<UInt8 *>(&model_data), reinterpret_cast<UInt8 *>(&_scale) };
+    UInt32 done = getTouchPadDataBatch(firstSelectors, firstBufs, countof(firstSelectors));
+
+    if (!(done & 0x1)) {
         bzero(&_capabilities, sizeof(_capabilities));
     }
         
     INFO_LOG("VoodooPS2Trackpad: nExtendedQueries=%d\n", _capabilities.extended_queries);
     INFO_LOG("VoodooPS2Trackpad: supports EW=%d\n", _capabilities.extended_w_supported);
     
-    buf = reinterpret_cast<UInt8 *>(&model_data);
-    if (getTouchPadData(SYNA_MODEL_QUERY, buf)) {
+    if (done & 0x2) {
         UInt16 combined_version = (_identity.major_ver << 8) | _identity.minor_ver;
         if (combined_version >= 0x705) {
             setProperty("Board ID", model_data.model_number, 32);
         }
     }
     
+    if (!(done & 0x4) || _scale.xupmm == 0 || _scale.yupmm == 0) {
+        // "Typical" values from docs
+        _scale.xupmm = 85;
+        _scale.yupmm = 94;
+    }
+    
 #ifdef SIMULATE_PASSTHRU
     _capabilities.passthrough = 1;
 #endif
@@ -291,16 +309,34 @@ void ApplePS2SynapticsTouchPad::queryCapabilities()
     INFO_LOG("VoodooPS2Trackpad: Passthrough=%d, Guest Present=%d\n",
              _capabilities.passthrough, model_data.guest_present);
     
+    // Queries that depend on the capabilities and model
+    UInt8 secondSelectors[3];
+    UInt8 *secondBufs[3];
+    int securepadIdx = -1, extendedIdx = -1, contCapsIdx = -1, n = 0;
+
     // Get button data in case VoodooRMI needs it
     if (model_data.more_extended_caps) {
-        buf = reinterpret_cast<UInt8 *>(&_securepad);
-        if (!getTouchPadData(SYNA_SECUREPAD_QUERY, buf)) {
-            bzero(&_securepad, sizeof(synaptics_securepad_id));
-        }
+        securepadIdx = n;
+        secondSelectors[n] = SYNA_SECUREPAD_QUERY;
+        secondBufs[n++] = reinterpret_cast<UInt8 *>(&_securepad);
+    }
+    if (_capabilities.extended_queries >= 1) {
+        extendedIdx = n;
+        secondSelectors[n] = SYNA_EXTENDED_ID_QUERY;
+        secondBufs[n++] = reinterpret_cast<UInt8 *>(&_extended_id);
+    }
+    if (_capabilities.extended_queries >= 4) {
+        contCapsIdx = n;
+        secondSelectors[n] = SYNA_CONT_CAPS_QUERY;
+        secondBufs[n++] = reinterpret_cast<UInt8 *>(&_cont_caps);
+    }
+    done = getTouchPadDataBatch(secondSelectors, secondBufs, n);
+
+    if (securepadIdx >= 0 && !(done & (1 << securepadIdx))) {
+        bzero(&_securepad, sizeof(synaptics_securepad_id));
     }
     
-    buf = reinterpret_cast<UInt8 *>(&_extended_id);
-    if (_capabilities.extended_queries >= 1 && getTouchPadData(SYNA_EXTENDED_ID_QUERY, buf)) {
+    if (extendedIdx >= 0 && (done & (1 << extendedIdx))) {
         INFO_LOG("VoodooPS2Trackpad: ledpresent=%d\n", _extended_id.has_leds);
         
         if (_extended_id.extended_btns > SYNAPTICS_MAX_EXT_BTNS) {
@@ -309,19 +345,17 @@ void ApplePS2SynapticsTouchPad::queryCapabilities()
         }
     }
     
-    // get resolution data for scaling x -> y or y -> x depending
-    if (!getTouchPadData(SYNA_SCALE_QUERY, reinterpret_cast<uint8_t *>(&_scale)) ||
-        _scale.xupmm == 0 || _scale.yupmm == 0) {
-        // "Typical" values from docs
-        _scale.xupmm = 85;
-        _scale.yupmm = 94;
-    }
+    // Button layout doesn't change after this point, so work out the masks used
+    // by synaptics_parse_hw_state here instead of on every packet.
+    // Extended buttons are spread over the low bits of byte 4 and 5, see synaptics_parse_ext_btns.
+    _middleBtnMask = _capabilities.middle_btn ? 0x4 : 0;
+    _extBtnsBitsMask = (1 << ((_extended_id.extended_btns + 1) / 2)) - 1;
+    _extBtnsMask = (1 << _extended_id.extended_btns) - 1;
     
     bool reports_min = false;
     bool reports_max = false;
     
-    buf = reinterpret_cast<UInt8 *>(&_cont_caps);
-    if (_capabilities.extended_queries >= 4 && getTouchPadData(SYNA_CONT_CAPS_QUERY, buf)) {
+    if (contCapsIdx >= 0 && (done & (1 << contCapsIdx))) {
         INFO_LOG("VoodooPS2Trackpad: Continued Capabilities($0C) = { smbus_addr=0x%x }\n",  _cont_caps.intertouch_addr);
 
 #ifdef SIMULATE_CLICKPAD
@@ -340,8 +374,22 @@ void ApplePS2SynapticsTouchPad::queryCapabilities()
         }
     }
     
-    buf = reinterpret_cast<UInt8 *>(&logic_size);
-    if (reports_max && getTouchPadData(SYNA_LOGIC_MAX_QUERY, buf))
+    // Coordinate ranges, as announced by the continued capabilities
+    synaptics_logic_min_max logic_min;
+    bzero(&logic_min, sizeof(synaptics_logic_min_max));
+    const UInt8 rangeSelectors[] = { SYNA_LOGIC_MAX_QUERY, SYNA_LOGIC_MIN_QUERY };
+    UInt8 *rangeBufs[] = { reinterpret_cast<UInt8 *>(&logic_size), reinterpret_cast<UInt8 *>(&logic_min) };
+    if (reports_max && reports_min) {
+        done = getTouchPadDataBatch(rangeSelectors, rangeBufs, 2);
+    } else if (reports_max) {
+        done = getTouchPadDataBatch(rangeSelectors, rangeBufs, 1);
+    } else if (reports_min) {
+        done = getTouchPadDataBatch(rangeSelectors + 1, rangeBufs + 1, 1) << 1;
+    } else {
+        done = 0;
+    }
+
+    if (done & 0x1)
     {
         logical_max_x = SYNA_LOGIC_X(logic_size);
         logical_max_y = SYNA_LOGIC_Y(logic_size);
@@ -353,10 +401,10 @@ void ApplePS2SynapticsTouchPad::queryCapabilities()
     margin_size_x = 5 * _scale.xupmm;
     margin_size_y = 5 * _scale.yupmm;
 
-    if (reports_min && getTouchPadData(SYNA_LOGIC_MIN_QUERY, buf))
+    if (done & 0x2)
     {
-        logical_min_x = SYNA_LOGIC_X(logic_size);
-        logical_min_y = SYNA_LOGIC_Y(logic_size);
+        logical_min_x = SYNA_LOGIC_X(logic_min);
+        logical_min_y = SYNA_LOGIC_Y(logic_min);
         DEBUG_LOG("VoodooPS2Trackpad: Minimum coords($0F) = { 0x%x, 0x%x }\n",
                   logical_min_x, logical_min_y);
     }
@@ -435,6 +483,9 @@ bool ApplePS2SynapticsTouchPad::start( IOService * provider )
     // successful probe and match.
     //
 
+    uint64_t start_abs, end_abs, start_ns;
+    clock_get_uptime(&start_abs);
+
     if (!super::start(provider))
         return false;
 
@@ -492,6 +543,7 @@ bool ApplePS2SynapticsTouchPad::start( IOService * provider )
     // Enable the mouse clock (should already be so) and the mouse IRQ line.
     // Enable the touchpad itself.
     //
+    clock_get_uptime(&_rateStateStart);
     enterAdvancedGestureMode();
 
     //
@@ -532,6 +584,11 @@ bool ApplePS2SynapticsTouchPad::start( IOService * provider )
     // Update LED -- it could have been disabled then computer was restarted
     //
     updateTouchpadLED();
+
+    clock_get_uptime(&end_abs);
+    absolutetime_to_nanoseconds(end_abs - start_abs, &start_ns);
+    setProperty("Start Time (us)", start_ns / 1000, 32);
+
     registerService();
     return true;
 }
@@ -628,6 +685,7 @@ PS2InterruptResult ApplePS2SynapticsTouchPad::interruptOccurred(UInt8 data)
     // any BLOCKING commands to our device in this context.
     //
     
+    _rateIrqs++;
     UInt8* packet = _ringBuffer.head();
 
     // special case for $AA $00, spontaneous reset (usually due to static electricity)
@@ -782,6 +840,9 @@ void ApplePS2SynapticsTouchPad::synaptics_parse_normal_packet(const UInt8 buf[],
     else if (fingerStates[0].y == Y_MAX_POSITIVE)
         fingerStates[0].y = YMAX;
     
+    if (w >= 4)
+        synaptics_calibrate_z(fingerStates[0].z);
+
     // count the number of fingers
     // my port of synaptics_image_sensor_process from synaptics.c from Linux Kernel
     int fingerCount = 0;
@@ -798,6 +859,8 @@ void ApplePS2SynapticsTouchPad::synaptics_parse_normal_packet(const UInt8 buf[],
     else if(w == 1)
         fingerCount = MAX(3, MIN(agmFingerCount, SYNAPTICS_MAX_FINGERS));
 
+    synaptics_interpolate_agm(fingerCount);
+
     clampedFingerCount = fingerCount;
     
     if (clampedFingerCount > SYNAPTICS_MAX_FINGERS)
@@ -832,6 +895,22 @@ void ApplePS2SynapticsTouchPad::synaptics_parse_agm_packet(const UInt8 buf[]) {
             else if (fingerStates[1].y == Y_MAX_POSITIVE)
                 fingerStates[1].y = YMAX;
 
+            {
+                // The dropped low bit is 0 or 1, so the middle of that range is the best guess.
+                // This packet comes between two normal packets, so the primary finger is
+                // about half a step further than in the last one.
+                auto &e = _agmEstimator;
+                int offsetX = fingerStates[1].x * 4 + 2 - (e.primaryX * 4 + e.primaryDX * 2);
+                int offsetY = fingerStates[1].y * 4 + 2 - (e.primaryY * 4 + e.primaryDY * 2);
+                e.offsetDX = offsetX - e.offsetX;
+                e.offsetDY = offsetY - e.offsetY;
+                e.offsetX = offsetX;
+                e.offsetY = offsetY;
+                e.period = e.packets > 0 ? e.packets : 1;
+                e.packets = 0;
+                if (e.samples < 2)
+                    e.samples++;
+            }
             break;
         case 2:
             DEBUG_LOG("synaptics_parse_hw_state: ===========FINGER COUNT PACKET===========");
@@ -844,6 +923,81 @@ void ApplePS2SynapticsTouchPad::synaptics_parse_agm_packet(const UInt8 buf[]) {
     }
 }
 
+// Learn z_finger from the pressure of single contact packets. Hovering and
+// touching show up as two modes below the palm range, z_finger follows the
+// split between them within [FingerZMin, FingerZMax], one step per update.
+// A configured FingerZ is never changed.
+void ApplePS2SynapticsTouchPad::synaptics_calibrate_z(int z) {
+    if (!autoFingerZ || fingerZConfigured || z == 0)
+        return;
+
+    _zHistogram.add(z);
+    if (++_zSamples < 256)
+        return;
+    _zSamples = 0;
+
+    // above twice the largest threshold is palm territory
+    int split = _zHistogram.threshold(4, 2 * z_finger_max, 26);
+    if (split < 0)
+        return;
+    if (split < z_finger_min)
+        split = z_finger_min;
+    else if (split > z_finger_max)
+        split = z_finger_max;
+
+    if (split == z_finger)
+        return;
+    z_finger += split > z_finger ? 1 : -1;
+    DEBUG_LOG("VoodooPS2Trackpad: FingerZ calibrated to %d (split at %d)\n", z_finger, split);
+    setProperty("FingerZLearned", z_finger, 32);
+}
+
+// Fill in the secondary finger for a normal packet. Without this it keeps the
+// position (at half resolution) of the last AGM packet, which only comes with
+// every other packet. The normal packet right after an AGM packet keeps that
+// measurement, it is newer than anything the estimate could give.
+void ApplePS2SynapticsTouchPad::synaptics_interpolate_agm(int fingerCount) {
+    auto &e = _agmEstimator;
+    auto &f1 = fingerStates[1];
+
+    if (fingerCount < 2) {
+        e.samples = 0;
+    }
+    else if (e.packets == 0) {
+        // fresh AGM sample
+        e.packets++;
+    }
+    else if (agmInterpolation && e.samples > 0 && e.packets < 2 * e.period) {
+        e.packets++;
+        int offsetX = e.offsetX;
+        int offsetY = e.offsetY;
+        if (e.samples >= 2) {
+            // the AGM packet came half a packet after the normal one before it
+            offsetX += e.offsetDX * (2 * e.packets - 1) / (2 * e.period);
+            offsetY += e.offsetDY * (2 * e.packets - 1) / (2 * e.period);
+        }
+        // past the edge clip() would take it for a larger pad
+        f1.x = MAX((int)logical_min_x, MIN((fingerStates[0].x * 4 + offsetX) >> 2, (int)logical_max_x));
+        f1.y = MAX((int)logical_min_y, MIN((fingerStates[0].y * 4 + offsetY) >> 2, (int)logical_max_y));
+    }
+    else {
+        // AGM packets stopped, leave the last one alone
+        e.packets++;
+    }
+
+    if (fingerCount > 0 && e.primaryValid) {
+        e.primaryDX = fingerStates[0].x - e.primaryX;
+        e.primaryDY = fingerStates[0].y - e.primaryY;
+    }
+    else {
+        e.primaryDX = 0;
+        e.primaryDY = 0;
+    }
+    e.primaryValid = fingerCount > 0;
+    e.primaryX = fingerStates[0].x;
+    e.primaryY = fingerStates[0].y;
+}
+
 void ApplePS2SynapticsTouchPad::synaptics_parse_passthru(const UInt8 buf[], UInt32 buttons) {
     AbsoluteTime timestamp;
     clock_get_uptime(&timestamp);
@@ -859,6 +1013,10 @@ void ApplePS2SynapticsTouchPad::synaptics_parse_passthru(const UInt8 buf[], UInt
     SInt32 dy = ((buf[1] & 0x20) ? 0xffffff00 : 0 ) | buf[5];
     buttons |= passbuttons;
     
+    uint64_t timestamp_ns;
+    absolutetime_to_nanoseconds(timestamp, &timestamp_ns);
+    _trackpointCurve.apply(dx, dy, timestamp_ns, buttons & 0x4);
+    
 #ifdef DEBUG_VERBOSE
     static int count = 0;
     IOLog("ps2: passthru packet dx=%d, dy=%d, buttons=%d (%d)\n", dx, dy, buttons, count++);
@@ -882,20 +1040,20 @@ int ApplePS2SynapticsTouchPad::synaptics_parse_ext_btns(const UInt8 buf[], const
         return _lastExtendedButtons;
     }
     
-    UInt8 btnBits = (_extended_id.extended_btns + 1) / 2;
-    int extendedBtns = 0;
+    // Moves bit i of a nibble to bit 2 * i
+    static const UInt8 spreadBits[16] = {
+        0x00, 0x01, 0x04, 0x05, 0x10, 0x11, 0x14, 0x15,
+        0x40, 0x41, 0x44, 0x45, 0x50, 0x51, 0x54, 0x55
+    };
     
     // Extended buttons have a pattern of:
     // Byte 4 X7 X6 X5 X4 B6 B4 B2 B0
     // Byte 5 Y7 Y6 Y5 Y4 B7 B5 B3 B1
     // This needs to be converted to one value with up to 8 buttons in it
-    for (int i = 0; i < btnBits; i++) {
-        UInt8 mask = 1 << i;
-        extendedBtns |= (buf[4] & mask) << i;
-        extendedBtns |= (buf[5] & mask) << (i + 1);
-    }
+    int extendedBtns = spreadBits[buf[4] & _extBtnsBitsMask] |
+                       (spreadBits[buf[5] & _extBtnsBitsMask] << 1);
     
-    extendedBtns &= (1 << _extended_id.extended_btns) - 1;
+    extendedBtns &= _extBtnsMask;
     _lastExtendedButtons = extendedBtns;
     return _lastExtendedButtons;
 }
@@ -921,11 +1079,11 @@ void ApplePS2SynapticsTouchPad::synaptics_parse_hw_state(const UInt8 buf[]) {
         _clickpad_pressed = xorBtns & 0x1;
     }
     
-    if (_capabilities.middle_btn && (xorBtns & 0x1)) {
-        buttons |= 0x4;
+    if (xorBtns & 0x1) {
+        buttons |= _middleBtnMask;
     }
     
-    if (_extended_id.extended_btns > 0) {
+    if (_extBtnsMask != 0) {
         buttons |= synaptics_parse_ext_btns(buf, w);
     }
     
@@ -1408,17 +1566,17 @@ void ApplePS2SynapticsTouchPad::sendTouchData() {
     bool dimensions_changed = false;
 
     int transducers_count = 0;
+    int rejected_count = 0;
+    bool rejected_button = false;
+    int thumb = -1;
     for(int i = 0; i < SYNAPTICS_MAX_FINGERS; i++) {
         const auto& state = virtualFingerStates[i];
-        if (!state.touch)
+        if (!state.touch) {
+            _disableZones.release(i);
+            _classifier.release(i);
             continue;
+        }
 
-        auto& transducer = inputEvent.transducers[transducers_count++];
-
-        transducer.type = FINGER;
-        transducer.isValid = true;
-        transducer.supportsPressure = true;
-        
         int posX = state.x_avg.average();
         int posY = state.y_avg.average();
 
@@ -1430,6 +1588,27 @@ void ApplePS2SynapticsTouchPad::sendTouchData() {
         
         DEBUG_LOG("synaptics_parse_hw_state finger[%d] x=%d y=%d raw_x=%d raw_y=%d", i, posX, posY, state.x_avg.average(), state.y_avg.average());
 
+        if (_disableZones.reject(i, posX, posY, logical_max_x - logical_min_x, logical_max_y - logical_min_y, timestamp_ns - keytime)) {
+            rejected_count++;
+            rejected_button |= state.button;
+            continue;
+        }
+
+        ContactClass type = _classifier.classify(i, posX, posY, state.pressure, state.width, logical_max_y - logical_min_y);
+        if (type == kContactPalm) {
+            rejected_count++;
+            rejected_button |= state.button;
+            continue;
+        }
+        if (type == kContactThumb)
+            thumb = transducers_count;
+
+        auto& transducer = inputEvent.transducers[transducers_count++];
+
+        transducer.type = FINGER;
+        transducer.isValid = true;
+        transducer.supportsPressure = true;
+
         transducer.previousCoordinates = transducer.currentCoordinates;
 
         transducer.currentCoordinates.x = posX;
@@ -1461,20 +1640,7 @@ void ApplePS2SynapticsTouchPad::sendTouchData() {
                     break;
                 }
 
-                double value;
-                if (state.pressure >= _forceTouchCustomDownThreshold) {
-                    value = 1.0;
-                } else if (state.pressure <= _forceTouchCustomUpThreshold) {
-                    value = 0.0;
-                } else {
-                    double base = ((double) (state.pressure - _forceTouchCustomUpThreshold)) / ((double) (_forceTouchCustomDownThreshold - _forceTouchCustomUpThreshold));
-                    value = 1;
-                    for (int j = 0; j < _forceTouchCustomPower; ++j) {
-                        value *= base;
-                    }
-                }
-
-                transducer.currentCoordinates.pressure = (int) (value * 255);
+                transducer.currentCoordinates.pressure = _forceTouchCurve.map(state.pressure);
                 break;
 
             case FORCE_TOUCH_DISABLED:
@@ -1497,14 +1663,23 @@ void ApplePS2SynapticsTouchPad::sendTouchData() {
 		transducer.secondaryId = i;
     }
 
+    ContactClassifier::markThumb(inputEvent, transducers_count, thumb);
+
 	for (int i = 0; i < transducers_count; i++)
 		for (int j = i + 1; j < transducers_count; j++)
 			if (inputEvent.transducers[i].fingerType == inputEvent.transducers[j].fingerType)
 				IOLog("synaptics_parse_hw_state: WTF!? equal finger types");
 
-    if (transducers_count != clampedFingerCount)
+    if (transducers_count + rejected_count != clampedFingerCount)
         IOLog("synaptics_parse_hw_state: WTF?! tducers_count %d clampedFingerCount %d", transducers_count, clampedFingerCount);
 
+    ContactClassifier::keepRejectedButton(inputEvent, transducers_count, rejected_button, _forceTouchMode == FORCE_TOUCH_BUTTON);
+
+    if (_disableZones.changed())
+        _disableZones.publish(this, "DisableZoneRejections");
+    if (_classifier.changed())
+        setProperty("Palms Rejected", _classifier.palms(), 32);
+
     // create new VoodooI2CMultitouchEvent
     inputEvent.contact_count = transducers_count;
     inputEvent.timestamp = timestamp;
@@ -1630,9 +1805,88 @@ bool ApplePS2SynapticsTouchPad::getTouchPadData(UInt8 dataSelector, UInt8 buf3[]
     return true;
 }
 
+// Each query is 4 set resolution pairs, a status request and 3 response bytes
+static constexpr int kQueryCommands = 12;
+static constexpr int kQueriesPerRequest = (kMaxCommands - 2) / kQueryCommands;
+
+//
+// Same as getTouchPadData for several selectors. Queries are sent back to back
+// with only one disable before and after each request, instead of around
+// every selector. A failed command ends its request, so any selector left
+// unread is retried on its own with getTouchPadData. Returns a bitmask of
+// the selectors that were read.
+//
+
+UInt32 ApplePS2SynapticsTouchPad::getTouchPadDataBatch(const UInt8 dataSelectors[], UInt8 *buf3s[], int count)
+{
+    UInt32 done = 0;
+
+    for (int first = 0; first < count; first += kQueriesPerRequest)
+    {
+        TPS2Request<> request;
+        int responses[kQueriesPerRequest];
+        int queries = count - first < kQueriesPerRequest ? count - first : kQueriesPerRequest;
+        int i = 0;
+
+        // Disable stream mode before the command sequence.
+        request.commands[i].command = kPS2C_SendCommandAndCompareAck;
+        request.commands[i++].inOrOut = kDP_SetDefaultsAndDisable;
+
+        for (int q = 0; q < queries; q++)
+        {
+            UInt8 dataSelector = dataSelectors[first + q];
+
+            // 4 set resolution commands, each encode 2 data bits.
+            for (int shift = 6; shift >= 0; shift -= 2)
+            {
+                request.commands[i].command = kPS2C_SendCommandAndCompareAck;
+                request.commands[i++].inOrOut = kDP_SetMouseResolution;
+                request.commands[i].command = kPS2C_SendCommandAndCompareAck;
+                request.commands[i++].inOrOut = (dataSelector >> shift) & 0x3;
+            }
+
+            // Read response bytes.
+            request.commands[i].command = kPS2C_SendCommandAndCompareAck;
+            request.commands[i++].inOrOut = kDP_GetMouseInformation;
+            responses[q] = i;
+            for (int b = 0; b < 3; b++)
+            {
+                request.commands[i].command = kPS2C_ReadDataPort;
+                request.commands[i++].inOrOut = 0;
+            }
+        }
+
+        request.commands[i].command = kPS2C_SendCommandAndCompareAck;
+        request.commands[i++].inOrOut = kDP_SetDefaultsAndDisable;
+        request.commandsCount = i;
+        assert(request.commandsCount <= countof(request.commands));
+        _device->submitRequestAndBlock(&request);
+
+        // a failed command ends the request, earlier responses are still good
+        for (int q = 0; q < queries; q++)
+        {
+            if (request.commandsCount < responses[q] + 3)
+                break;
+            buf3s[first + q][0] = request.commands[responses[q]].inOrOut;
+            buf3s[first + q][1] = request.commands[responses[q] + 1].inOrOut;
+            buf3s[first + q][2] = request.commands[responses[q] + 2].inOrOut;
+            done |= 1 << (first + q);
+        }
+    }
+
+    // a NAK on one selector must not cost the ones queued after it
+    for (int q = 0; q < count; q++)
+    {
+        if (!(done & (1 << q)) && getTouchPadData(dataSelectors[q], buf3s[q]))
+            done |= 1 << q;
+    }
+
+    return done;
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2SynapticsTouchPad::initTouchPad()
+bool ApplePS2SynapticsTouchPad::initTouchPad()
 {
     //
     // Clear packet buffer pointer to avoid issues caused by
@@ -1654,14 +1908,116 @@ void ApplePS2SynapticsTouchPad::initTouchPad()
     // Resend the touchpad mode byte sequence
     // IRQ is enabled as side effect of setting mode byte
     // Also touchpad is enabled as side effect
+    // Start over awake, updateTouchpadLED puts the pad back to sleep if
+    // input is still ignored.
     //
     
-    enterAdvancedGestureMode();
+    accountReportRate();
+    _reportRate = kReportRateHigh;
+    
+    bool success = enterAdvancedGestureMode();
     
     //
     // Set LED state as it is lost after sleep
     //
     updateTouchpadLED();
+
+    return success;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Interval between GetId polls while waiting for the touchpad after wake,
+// doubled after each unanswered poll up to the maximum
+#define kResumePollInterval     10
+#define kResumePollIntervalMax  80
+
+bool ApplePS2SynapticsTouchPad::getDeviceId()
+{
+    // GetId only reads, it neither resets nor reconfigures the device
+    TPS2Request<2> request;
+    request.commands[0].command = kPS2C_SendCommandAndCompareAck;
+    request.commands[0].inOrOut = kDP_GetId;
+    request.commands[1].command = kPS2C_ReadDataPort;
+    request.commands[1].inOrOut = 0;
+    request.commandsCount = 2;
+    _device->submitRequestAndBlock(&request);
+
+    return 2 == request.commandsCount;
+}
+
+bool ApplePS2SynapticsTouchPad::resumeTouchPad()
+{
+    //
+    // Instead of waiting a fixed wakedelay before each step, poll with GetId
+    // until the touchpad answers, then check it with the identify query. If
+    // it is still the touchpad found in probe, the mode byte and AGM are
+    // restored from the cached capabilities. Returns false if the full wake
+    // sequence is still needed.
+    //
+
+    if (!fastResume)
+        return false;
+
+    uint64_t start_abs, now_abs, ready_abs, end_abs, ns;
+    clock_get_uptime(&start_abs);
+
+    // wakedelay bounds the time spent, including the controller timeouts
+    // of unanswered polls
+    bool ready = false;
+    for (int interval = kResumePollInterval; ; interval = MIN(2 * interval, kResumePollIntervalMax))
+    {
+        if (getDeviceId())
+        {
+            ready = true;
+            break;
+        }
+        clock_get_uptime(&now_abs);
+        absolutetime_to_nanoseconds(now_abs - start_abs, &ns);
+        if (ns >= (uint64_t)wakedelay * 1000000)
+            break;
+        IOSleep(interval);
+    }
+
+    clock_get_uptime(&ready_abs);
+    absolutetime_to_nanoseconds(ready_abs - start_abs, &ns);
+    setProperty("Wake Poll Time (us)", ns / 1000, 32);
+
+    if (!ready)
+    {
+        IOLog("VoodooPS2Trackpad: TouchPad did not answer within %d ms after wake\n", wakedelay);
+        return false;
+    }
+
+    synaptics_identify_trackpad identity;
+    if (!getTouchPadData(SYNAPTICS_IDENTIFY_QUERY, reinterpret_cast<uint8_t*>(&identity)))
+    {
+        IOLog("VoodooPS2Trackpad: TouchPad answered GetId but not the identify query after wake\n");
+        return false;
+    }
+
+    if (memcmp(&identity, &_identity, sizeof(identity)))
+    {
+        IOLog("VoodooPS2Trackpad: Identity changed to { 0x%x.%x, constant: %x } on wake, querying capabilities again\n",
+              identity.major_ver, identity.minor_ver, identity.synaptics_const);
+        _identity = identity;
+        queryCapabilities();
+        return false;
+    }
+
+    // Mode byte also clears the sleep bit set on disable
+    if (!initTouchPad())
+        return false;
+    setTouchPadEnable(true); // Send extra kDP_Enable
+
+    clock_get_uptime(&end_abs);
+    absolutetime_to_nanoseconds(end_abs - ready_abs, &ns);
+    setProperty("Wake Restore Time (us)", ns / 1000, 32);
+    absolutetime_to_nanoseconds(end_abs - start_abs, &ns);
+    setProperty("Wake Time (us)", ns / 1000, 32);
+    DEBUG_LOG("VoodooPS2Trackpad: fast resume took %llu us\n", ns / 1000);
+
+    return true;
 }
 
 bool ApplePS2SynapticsTouchPad::enterAdvancedGestureMode()
@@ -1708,7 +2064,8 @@ bool ApplePS2SynapticsTouchPad::enterAdvancedGestureMode()
     //  for a PS2Request is 30.  So don't add any. Break it into multiple
     //  requests!
     
-    setModeByte(false);
+    // the final enable only counts if the mode byte went through as well
+    bool modeSet = setModeByte(false);
 
 #ifdef UNDOCUMENTED_INIT_SEQUENCE_POST
     // maybe this is commit?
@@ -1739,7 +2096,7 @@ bool ApplePS2SynapticsTouchPad::enterAdvancedGestureMode()
     if (i != request.commandsCount)
         DEBUG_LOG("VoodooPS2Trackpad: sending final init sequence failed: %d\n", request.commandsCount);
 
-    return i == request.commandsCount;
+    return modeSet && i == request.commandsCount;
 }
 
 // simplified setModeByte for switching between normal mode and EW mode
@@ -1756,7 +2113,7 @@ bool ApplePS2SynapticsTouchPad::setModeByte(bool sleep)
         _cont_caps.advanced_gestures || _cont_caps.reports_v)
         modeByte |= SYNA_MODE_EXT_W;
     
-    if (sleep)
+    if (sleep || _reportRate == kReportRateSleep)
         modeByte |= SYNA_MODE_SLEEP;
 
     int i;
@@ -1799,6 +2156,79 @@ bool ApplePS2SynapticsTouchPad::setModeByte(bool sleep)
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2SynapticsTouchPad::setReportRate(ReportRate rate)
+{
+    if (rate == _reportRate || !_device)
+        return;
+
+    DEBUG_LOG("VoodooPS2Trackpad: report rate %d -> %d\n", _reportRate, rate);
+    accountReportRate();
+
+    // setModeByte builds the mode byte from _reportRate, so it is set for
+    // the attempt and only kept if the pad took it.
+    ReportRate previous = _reportRate;
+    _reportRate = rate;
+
+    // When going to sleep the pad is still streaming, so the first attempt
+    // can see a data byte instead of an ACK. Stream mode is off after the
+    // first F5 though, so a retry goes through.
+    bool success = enterAdvancedGestureMode();
+    for (int retry = 0; !success && retry < 2; retry++)
+    {
+        DEBUG_LOG("VoodooPS2Trackpad: retrying mode byte for report rate %d\n", rate);
+        success = enterAdvancedGestureMode();
+    }
+    if (!success)
+    {
+        // F5 may have stopped the stream, put the old mode back
+        IOLog("VoodooPS2Trackpad: report rate %d not accepted, staying at %d\n", rate, previous);
+        _reportRate = previous;
+        enterAdvancedGestureMode();
+    }
+
+    // bytes from before the switch must not be framed with the new stream
+    _packetByteCount = 0;
+    _ringBuffer.reset();
+
+    publishReportRateStats();
+}
+
+void ApplePS2SynapticsTouchPad::updateReportRate()
+{
+    // ignoreall also covers usb_mouse_stops_trackpad, nothing is reported
+    // in that state so the sensor can sleep
+    if (ignoreall && !disableDeepSleep)
+        setReportRate(kReportRateSleep);
+    else if (_reportRate == kReportRateSleep)
+        setReportRate(kReportRateHigh);
+}
+
+void ApplePS2SynapticsTouchPad::accountReportRate()
+{
+    uint64_t now_abs, ns;
+    clock_get_uptime(&now_abs);
+    absolutetime_to_nanoseconds(now_abs - _rateStateStart, &ns);
+    _rateTotalTime[_reportRate] += ns;
+    _rateTotalIrqs[_reportRate] += _rateIrqs;
+    _rateIrqs = 0;
+    _rateStateStart = now_abs;
+}
+
+void ApplePS2SynapticsTouchPad::publishReportRateStats()
+{
+    static const char* const names[kReportRateCount] = { "IRQ/s High Rate", "IRQ/s Sleep" };
+
+    accountReportRate();
+    for (int i = 0; i < kReportRateCount; i++)
+    {
+        uint64_t ms = _rateTotalTime[i] / 1000000;
+        if (ms)
+            setProperty(names[i], _rateTotalIrqs[i] * 1000 / ms, 32);
+    }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 void ApplePS2SynapticsTouchPad::setPropertiesGated(OSDictionary * config)
 {
 	if (NULL == config)
@@ -1806,6 +2236,8 @@ void ApplePS2SynapticsTouchPad::setPropertiesGated(OSDictionary * config)
     
 	const struct {const char *name; int *var;} int32vars[]={
         {"FingerZ",                         &z_finger},
+        {"FingerZMin",                      &z_finger_min},
+        {"FingerZMax",                      &z_finger_max},
         {"WakeDelay",                       &wakedelay},
         {"MinLogicalXOverride",             &minXOverride},
         {"MinLogicalYOverride",             &minYOverride},
@@ -1835,7 +2267,10 @@ void ApplePS2SynapticsTouchPad::setPropertiesGated(OSDictionary * config)
  	};
     const struct {const char* name; bool* var;} lowbitvars[]={
         {"USBMouseStopsTrackpad",           &usb_mouse_stops_trackpad},
-        {"DisableDeepSleep",                &disableDeepSleep}
+        {"DisableDeepSleep",                &disableDeepSleep},
+        {"FastResume",                      &fastResume},
+        {"AGMInterpolation",                &agmInterpolation},
+        {"AutoFingerZ",                     &autoFingerZ}
     };
     const struct {const char* name; uint64_t* var; } int64vars[]={
         {"QuietTimeAfterTyping",            &maxaftertyping},
@@ -1845,6 +2280,24 @@ void ApplePS2SynapticsTouchPad::setPropertiesGated(OSDictionary * config)
 	OSBoolean *bl;
     
     OSNumber *num;
+    OSArray *zones;
+    if ((zones = OSDynamicCast(OSArray, config->getObject("DisableZones"))))
+    {
+        _disableZones.load(zones);
+        setProperty("DisableZones", zones);
+    }
+    OSDictionary *palm;
+    if ((palm = OSDynamicCast(OSDictionary, config->getObject("PalmClassifier"))))
+    {
+        _classifier.load(palm);
+        setProperty("PalmClassifier", palm);
+    }
+    OSDictionary *curve;
+    if ((curve = OSDynamicCast(OSDictionary, config->getObject("TrackpointCurve"))))
+    {
+        _trackpointCurve.load(curve);
+        setProperty("TrackpointCurve", curve);
+    }
     // 64-bit config items
     for (int i = 0; i < countof(int64vars); i++)
         if ((num=OSDynamicCast(OSNumber, config->getObject(int64vars[i].name))))
@@ -1866,6 +2319,16 @@ void ApplePS2SynapticsTouchPad::setPropertiesGated(OSDictionary * config)
 			*int32vars[i].var = num->unsigned32BitValue();
             setProperty(int32vars[i].name, *int32vars[i].var, 32);
         }
+    // an explicit FingerZ (per-model profile, SSDT) is used as is, only the
+    // default threshold is calibrated or restored from a learned value
+    if (OSDynamicCast(OSNumber, config->getObject("FingerZ")))
+        fingerZConfigured = true;
+    else if (!fingerZConfigured && (num=OSDynamicCast(OSNumber, config->getObject("FingerZLearned"))))
+    {
+        // a stale value may lie outside the current bounds
+        z_finger = MAX(z_finger_min, MIN((int)num->unsigned32BitValue(), z_finger_max));
+        setProperty("FingerZLearned", z_finger, 32);
+    }
     // lowbit config items
 	for (int i = 0; i < countof(lowbitvars); i++)
     {
@@ -1897,6 +2360,8 @@ void ApplePS2SynapticsTouchPad::setPropertiesGated(OSDictionary * config)
             PE_parse_boot_argn("auth-root-dmg", val, sizeof(val)))
         _forceTouchMode = FORCE_TOUCH_DISABLED;
     }
+
+    _forceTouchCurve.build(_forceTouchCustomUpThreshold, _forceTouchCustomDownThreshold, _forceTouchCustomPower);
     
     setTrackpointProperties();
     if (voodooInputInstance != nullptr) {
@@ -1954,6 +2419,8 @@ void ApplePS2SynapticsTouchPad::setDevicePowerState( UInt32 whatToDo )
 
             setTouchPadEnable( false ); // Disable stream mode
 
+            publishReportRateStats();
+
             if (!disableDeepSleep) {
                 setModeByte(true); // Enable sleep
             }
@@ -1963,8 +2430,16 @@ void ApplePS2SynapticsTouchPad::setDevicePowerState( UInt32 whatToDo )
             //
             // Must not issue any commands before the device has
             // completed its power-on self-test and calibration.
+            // The exception is the fast resume path: it polls with GetId,
+            // which only reads the device id and changes no state. A pad
+            // still in self-test does not answer it, and nothing else is
+            // sent until it does. The full sequence below still waits the
+            // fixed wakedelay.
             //
 
+            if (resumeTouchPad())
+                break;
+
             if (!disableDeepSleep) {
                 IOSleep(wakedelay);
                 setModeByte(false);
@@ -2024,9 +2499,12 @@ IOReturn ApplePS2SynapticsTouchPad::message(UInt32 type, IOService* provider, vo
             if (*reqCode == 1)
             {
                 ignoreall = false;
-                initTouchPad();
-                IOSleep(wakedelay);
-                setTouchPadEnable(true); // Send extra kDP_Enable
+                if (!resumeTouchPad())
+                {
+                    initTouchPad();
+                    IOSleep(wakedelay);
+                    setTouchPadEnable(true); // Send extra kDP_Enable
+                }
                 updateTouchpadLED();
             }
             break;
@@ -2156,6 +2634,9 @@ IOReturn ApplePS2SynapticsTouchPad::message(UInt32 type, IOService* provider, vo
 
 void ApplePS2SynapticsTouchPad::updateTouchpadLED()
 {
+    // every change of ignoreall ends up here
+    updateReportRate();
+
     if (_extended_id.has_leds && !noled)
         setTouchpadLED(ignoreall ? 0x88 : 0x10);
 
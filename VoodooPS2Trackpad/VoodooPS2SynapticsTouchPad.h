@@ -37,6 +37,21 @@ struct synaptics_hw_state {
     int virtualFingerIndex;
 };
 
+// Secondary finger estimate between AGM packets. The secondary finger is
+// tracked as an offset from the primary one, so it follows the primary
+// finger in between and its own motion (the change of the offset) is
+// extrapolated from the last two AGM packets. Offsets are in 1/4 units.
+struct synaptics_agm_estimator {
+    int offsetX, offsetY;
+    int offsetDX, offsetDY;
+    int primaryX, primaryY;
+    int primaryDX, primaryDY;   // primary motion between the last two normal packets
+    bool primaryValid;
+    int packets;            // packets since the last AGM packet
+    int period;             // packets between the last two AGM packets
+    int samples;            // AGM packets seen during this touch, up to 2
+};
+
 /*
  Если touch = false, то палец игнорируется.
  Соответствие физических и виртуальных пальцев - динамическое.
@@ -228,6 +243,14 @@ private:
 	IOCommandGate*      _cmdGate {nullptr};
     IOACPIPlatformDevice*_provider {nullptr};
     
+    // Report rate: hardware sleep while all input is ignored anyway
+    enum ReportRate { kReportRateHigh, kReportRateSleep, kReportRateCount };
+    ReportRate _reportRate {kReportRateHigh};
+    uint64_t _rateStateStart {0};
+    UInt32 _rateIrqs {0};
+    uint64_t _rateTotalIrqs[kReportRateCount] {};
+    uint64_t _rateTotalTime[kReportRateCount] {};
+    
 	VoodooInputEvent inputEvent {};
     TrackpointReport trackpointReport {};
     
@@ -248,6 +271,7 @@ private:
     bool freeFingerTypes[kMT2FingerTypeCount];
 
     bool disableDeepSleep {false};
+    bool fastResume {true};
 
     static_assert(SYNAPTICS_MAX_FINGERS <= kMT2FingerTypeLittleFinger, "Too many fingers for one hand");
 
@@ -262,6 +286,8 @@ private:
     
     void synaptics_parse_normal_packet(const UInt8 buf[], const int w);
     void synaptics_parse_agm_packet(const UInt8 buf[]);
+    void synaptics_interpolate_agm(int fingerCount);
+    void synaptics_calibrate_z(int z);
     void synaptics_parse_passthru(const UInt8 buf[], const UInt32 buttons);
     int synaptics_parse_ext_btns(const UInt8 buf[], const int w);
     void synaptics_parse_hw_state(const UInt8 buf[]);
@@ -279,23 +305,38 @@ private:
     int _forceTouchCustomDownThreshold {90};
     int _forceTouchCustomUpThreshold {20};
     int _forceTouchCustomPower {8};
+    ForceTouchCurve _forceTouchCurve {};
     
     int clampedFingerCount {0};
     int agmFingerCount {0};
+    synaptics_agm_estimator _agmEstimator {};
+    bool agmInterpolation {true};
 	bool wasSkipped {false};
 	int z_finger {45};
     int zlimit {0};
+    bool autoFingerZ {true};
+    bool fingerZConfigured {false};
+    int z_finger_min {30}, z_finger_max {70};
+    PressureHistogram _zHistogram {};
+    int _zSamples {0};
     int noled {0};
     uint64_t maxaftertyping {500000000};
     uint64_t maxafterspecialtyping {0};
     int specialKey {0x80};
     int wakedelay {1000};
     int hwresetonstart {0};
-    int diszl {0}, diszr {0}, diszt {0}, diszb {0};
+    DisableZoneMap _disableZones {};
+    ContactClassifier _classifier {kContactClassifierDefaults};
+    TrackpointCurve _trackpointCurve {};
     int minXOverride {-1}, minYOverride {-1}, maxXOverride {-1}, maxYOverride {-1};
 
     int _lastExtendedButtons {0};
     int _lastPassthruButtons {0};
+
+    // Button decoding masks, derived once from the capabilities in queryCapabilities()
+    UInt32 _middleBtnMask {0};
+    UInt8 _extBtnsBitsMask {0};
+    UInt8 _extBtnsMask {0};
     
     // Trackpoint information
     int _scrollMultiplierX {1};
@@ -335,15 +376,10 @@ private:
     
 	int _modifierdown {0}; // state of left+right control keys
     
-    inline bool isInDisableZone(int x, int y)
-        { return x > diszl && x < diszr && y > diszb && y < diszt; }
-	
-    // Sony: coordinates captured from single touch event
-    // Don't know what is the exact value of x and y on edge of touchpad
-    // the best would be { return x > xmax/2 && y < ymax/4; }
 
     virtual void   setTouchPadEnable( bool enable );
     virtual bool   getTouchPadData( UInt8 dataSelector, UInt8 buf3[] );
+    UInt32 getTouchPadDataBatch(const UInt8 dataSelectors[], UInt8 *buf3s[], int count);
     virtual bool   getTouchPadStatus(  UInt8 buf3[] );
 	virtual PS2InterruptResult interruptOccurred(UInt8 data);
     virtual void packetReady();
@@ -351,9 +387,15 @@ private:
     
     void updateTouchpadLED();
     bool setTouchpadLED(UInt8 touchLED);
-    void initTouchPad();
+    bool initTouchPad();
+    bool getDeviceId();
+    bool resumeTouchPad();
     bool enterAdvancedGestureMode();
     bool setModeByte(bool sleep);
+    void setReportRate(ReportRate rate);
+    void updateReportRate();
+    void accountReportRate();
+    void publishReportRateStats();
 
     inline bool isFingerTouch(int z) { return z>z_finger && z<zlimit; }
     
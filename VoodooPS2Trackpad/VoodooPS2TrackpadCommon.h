@@ -9,6 +9,8 @@
 #ifndef VoodooPS2TrackpadCommon_h
 #define VoodooPS2TrackpadCommon_h
 
+#include "VoodooInputMultitouch/VoodooInputEvent.h"
+
 #define TEST_BIT(x, y) ((x >> y) & 0x1)
 
 void inline PS2DictSetNumber(OSDictionary *dict, const char *key, unsigned int num) {
@@ -145,6 +147,386 @@ public:
     }
 };
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PressureHistogram Class Declaration
+//
+// Streaming histogram of contact pressure (0-255) in bins of 4. Counts are
+// halved when the total gets large, so old samples fade out. threshold()
+// finds the split between hovering and touching (Otsu's method).
+//
+
+class PressureHistogram
+{
+private:
+    static constexpr int kBinShift = 2;
+    static constexpr int kBins = 256 >> kBinShift;
+    static constexpr UInt32 kMaxTotal = 16384;
+    UInt32 m_bins[kBins];
+    UInt32 m_total;
+
+public:
+    inline PressureHistogram() { reset(); }
+    inline void reset()
+    {
+        bzero(m_bins, sizeof(m_bins));
+        m_total = 0;
+    }
+    void add(int pressure)
+    {
+        if (pressure < 0)
+            pressure = 0;
+        else if (pressure > 255)
+            pressure = 255;
+        m_bins[pressure >> kBinShift]++;
+        if (++m_total < kMaxTotal)
+            return;
+        m_total = 0;
+        for (int i = 0; i < kBins; i++) {
+            m_bins[i] >>= 1;
+            m_total += m_bins[i];
+        }
+    }
+    inline UInt32 total() const { return m_total; }
+    // Pressure that best splits the samples in [low, high) into two classes,
+    // or -1 if they are not clearly bimodal with at least minShare/256 of them
+    // on both sides.
+    int threshold(int low, int high, int minShare) const
+    {
+        int first = low >> kBinShift;
+        int last = high >> kBinShift;
+        if (last > kBins)
+            last = kBins;
+
+        SInt64 n = 0, sum = 0;
+        for (int i = first; i < last; i++) {
+            n += m_bins[i];
+            sum += (SInt64)i * m_bins[i];
+        }
+        if (n == 0)
+            return -1;
+
+        // between class variance is proportional to (n0 * sum - n * sum0)^2 / (n0 * n1)
+        SInt64 n0 = 0, sum0 = 0, best = 0;
+        int split = -1;
+        for (int i = first + 1; i < last; i++) {
+            n0 += m_bins[i - 1];
+            sum0 += (SInt64)(i - 1) * m_bins[i - 1];
+            SInt64 n1 = n - n0;
+            if (n0 * 256 < minShare * n || n1 * 256 < minShare * n)
+                continue;
+            SInt64 diff = n0 * sum - n * sum0;
+            SInt64 variance = (diff / n0) * (diff / n1);
+            if (variance > best) {
+                best = variance;
+                split = i;
+            }
+        }
+        if (split < 0)
+            return -1;
+
+        // Only a split at a valley counts, a single mode gets split in the middle too
+        UInt32 peak0 = 0, peak1 = 0;
+        for (int i = first; i < split; i++)
+            if (m_bins[i] > peak0)
+                peak0 = m_bins[i];
+        for (int i = split; i < last; i++)
+            if (m_bins[i] > peak1)
+                peak1 = m_bins[i];
+        UInt32 valley = m_bins[split - 1] < m_bins[split] ? m_bins[split - 1] : m_bins[split];
+        if (2 * valley > (peak0 < peak1 ? peak0 : peak1))
+            return -1;
+        return split << kBinShift;
+    }
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// DisableZoneMap Class Declaration
+//
+// Zones where new contacts are ignored, e.g. for palms along the edges.
+// Zones are rectangles in percent of the trackpad (origin top left), loaded
+// from the DisableZones array, each optionally only active for a time after
+// the last keystroke. They are rasterised into a coarse grid, so checking a
+// contact is one lookup. A contact is judged where it lands and keeps that
+// verdict until it is released.
+//
+
+#define kDisableZoneMax         8
+#define kDisableZoneGrid        32
+#define kDisableZoneMaxContacts 16
+
+class DisableZoneMap
+{
+private:
+    UInt8 m_cells[kDisableZoneGrid][kDisableZoneGrid];
+    uint64_t m_afterTyping[kDisableZoneMax];   // ns, 0 means always active
+    UInt32 m_rejected[kDisableZoneMax];
+    int m_count;
+    bool m_changed;
+    // 0 not judged yet, 1 accepted, 2 + zone rejected
+    UInt8 m_contacts[kDisableZoneMaxContacts];
+
+public:
+    inline DisableZoneMap() { reset(); }
+    void reset()
+    {
+        bzero(m_cells, sizeof(m_cells));
+        bzero(m_afterTyping, sizeof(m_afterTyping));
+        bzero(m_rejected, sizeof(m_rejected));
+        bzero(m_contacts, sizeof(m_contacts));
+        m_count = 0;
+        m_changed = false;
+    }
+    inline int count() const { return m_count; }
+    inline bool changed() const { return m_changed; }
+    bool addZone(int left, int top, int right, int bottom, uint64_t afterTyping)
+    {
+        if (m_count >= kDisableZoneMax || left >= right || top >= bottom)
+            return false;
+        int x0 = left < 0 ? 0 : left * kDisableZoneGrid / 100;
+        int y0 = top < 0 ? 0 : top * kDisableZoneGrid / 100;
+        int x1 = right > 100 ? kDisableZoneGrid : (right * kDisableZoneGrid + 99) / 100;
+        int y1 = bottom > 100 ? kDisableZoneGrid : (bottom * kDisableZoneGrid + 99) / 100;
+        for (int y = y0; y < y1; y++)
+            for (int x = x0; x < x1; x++)
+                m_cells[y][x] |= 1 << m_count;
+        m_afterTyping[m_count++] = afterTyping;
+        return true;
+    }
+    void load(OSArray *zones)
+    {
+        reset();
+        if (!zones)
+            return;
+        for (unsigned int i = 0; i < zones->getCount(); i++) {
+            OSDictionary *zone = OSDynamicCast(OSDictionary, zones->getObject(i));
+            if (!zone)
+                continue;
+            static const char* const keys[] = { "Left", "Top", "Right", "Bottom", "AfterTyping" };
+            int values[] = { 0, 0, 100, 100, 0 };
+            for (int k = 0; k < 5; k++)
+                if (OSNumber *num = OSDynamicCast(OSNumber, zone->getObject(keys[k])))
+                    values[k] = num->unsigned32BitValue();
+            addZone(values[0], values[1], values[2], values[3], (uint64_t)values[4] * 1000000);
+        }
+    }
+    // True if the contact should be ignored. x, y are in 0..width, 0..height
+    // with the origin at the top left, sinceKey is the time since the last
+    // keystroke in ns.
+    bool reject(int id, int x, int y, int width, int height, uint64_t sinceKey)
+    {
+        if (m_count == 0 || id < 0 || id >= kDisableZoneMaxContacts)
+            return false;
+        if (m_contacts[id])
+            return m_contacts[id] > 1;
+
+        m_contacts[id] = 1;
+        if (width <= 0 || height <= 0)
+            return false;
+        int cx = x * kDisableZoneGrid / width;
+        int cy = y * kDisableZoneGrid / height;
+        cx = cx < 0 ? 0 : (cx >= kDisableZoneGrid ? kDisableZoneGrid - 1 : cx);
+        cy = cy < 0 ? 0 : (cy >= kDisableZoneGrid ? kDisableZoneGrid - 1 : cy);
+        for (int zones = m_cells[cy][cx], i = 0; zones; zones >>= 1, i++) {
+            if (!(zones & 1) || (m_afterTyping[i] && sinceKey >= m_afterTyping[i]))
+                continue;
+            m_contacts[id] = 2 + i;
+            m_rejected[i]++;
+            m_changed = true;
+            return true;
+        }
+        return false;
+    }
+    inline void release(int id)
+    {
+        if (id >= 0 && id < kDisableZoneMaxContacts)
+            m_contacts[id] = 0;
+    }
+    // Number of contacts each zone has rejected
+    void publish(IOService *service, const char *key)
+    {
+        m_changed = false;
+        OSArray *counts = OSArray::withCapacity(m_count);
+        if (!counts)
+            return;
+        for (int i = 0; i < m_count; i++) {
+            if (OSNumber *num = OSNumber::withNumber(m_rejected[i], 32)) {
+                counts->setObject(num);
+                num->release();
+            }
+        }
+        service->setProperty(key, counts);
+        counts->release();
+    }
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// ContactClassifier Class Declaration
+//
+// Marks each contact as finger, thumb or palm from integer features: width,
+// pressure, how fast the pressure grows while landing, distance from the
+// bottom edge and speed. Palms are only detected while landing and stay palms
+// until released, so a hard press later on never drops a finger. A threshold
+// of 0 turns its feature off; all of them can be set with the PalmClassifier
+// dictionary, in the units of the driver.
+//
+
+#define kContactClassifierMaxContacts   16
+#define kContactLandingSamples          6
+
+enum ContactClass {
+    kContactFinger,
+    kContactThumb,
+    kContactPalm
+};
+
+struct ContactClassifierParams {
+    int palmWidth;      // width at or above which a landing contact is a palm
+    int palmPressure;   // pressure at or above which a landing contact is a palm
+    int palmGrowth;     // pressure increase per sample that makes a landing contact a palm
+    int thumbZone;      // percent of the height at the bottom where thumbs rest
+    int thumbSpeed;     // thumbs move less than this, per mille of the height per sample
+};
+
+// every rule is off until PalmClassifier turns it on, thumbSpeed only
+// matters once ThumbZone is set
+static const ContactClassifierParams kContactClassifierDefaults = {0, 0, 0, 0, 5};
+
+class ContactClassifier
+{
+private:
+    struct Contact {
+        int x, y, z;
+        int growth;     // largest pressure increase while landing
+        int speed;      // 1/16 per mille of the height per sample, averaged
+        UInt8 samples;
+        UInt8 type;
+        bool active;
+    };
+    Contact m_contacts[kContactClassifierMaxContacts];
+    UInt32 m_palms;
+    bool m_changed;
+
+public:
+    ContactClassifierParams params;
+
+    inline ContactClassifier(const ContactClassifierParams &defaults) : params(defaults) { reset(); }
+    inline void reset()
+    {
+        bzero(m_contacts, sizeof(m_contacts));
+        m_palms = 0;
+        m_changed = false;
+    }
+    void load(OSDictionary *config)
+    {
+        if (!config)
+            return;
+        const struct {const char *name; int *var;} vars[] = {
+            {"PalmWidth",       &params.palmWidth},
+            {"PalmPressure",    &params.palmPressure},
+            {"PalmGrowth",      &params.palmGrowth},
+            {"ThumbZone",       &params.thumbZone},
+            {"ThumbSpeed",      &params.thumbSpeed},
+        };
+        for (int i = 0; i < 5; i++)
+            if (OSNumber *num = OSDynamicCast(OSNumber, config->getObject(vars[i].name)))
+                *vars[i].var = num->unsigned32BitValue();
+    }
+    // x, y have their origin at the top left, height is the trackpad height in the same units
+    ContactClass classify(int id, int x, int y, int z, int w, int height)
+    {
+        if (id < 0 || id >= kContactClassifierMaxContacts || height <= 0)
+            return kContactFinger;
+
+        Contact &c = m_contacts[id];
+        if (!c.active) {
+            bzero(&c, sizeof(c));
+            c.active = true;
+        } else {
+            int dx = x - c.x, dy = y - c.y;
+            int v = ((dx < 0 ? -dx : dx) + (dy < 0 ? -dy : dy)) * 1000 / height;
+            c.speed = (c.speed * 3 + v * 16) / 4;
+            if (c.samples < kContactLandingSamples && z - c.z > c.growth)
+                c.growth = z - c.z;
+        }
+        c.x = x;
+        c.y = y;
+        c.z = z;
+
+        if (c.type == kContactPalm)
+            return kContactPalm;
+
+        if (c.samples < kContactLandingSamples) {
+            c.samples++;
+            if ((params.palmWidth && w >= params.palmWidth) ||
+                (params.palmPressure && z >= params.palmPressure) ||
+                (params.palmGrowth && c.growth >= params.palmGrowth)) {
+                c.type = kContactPalm;
+                m_palms++;
+                m_changed = true;
+                return kContactPalm;
+            }
+        }
+
+        // a new contact has no speed yet, so it can't be told from a resting one
+        bool settled = c.samples >= kContactLandingSamples;
+        bool resting = c.speed < params.thumbSpeed * 16;
+        bool bottom = y * 100 >= height * (100 - params.thumbZone);
+        c.type = params.thumbZone && settled && resting && bottom ? kContactThumb : kContactFinger;
+        return (ContactClass)c.type;
+    }
+    inline void release(int id)
+    {
+        if (id >= 0 && id < kContactClassifierMaxContacts)
+            m_contacts[id].active = false;
+    }
+    inline bool changed() const { return m_changed; }
+    inline UInt32 palms()
+    {
+        m_changed = false;
+        return m_palms;
+    }
+    // Give the thumb finger type to transducer thumb, swapping with the one that has it.
+    // Only with 3 or more contacts, with 2 the other one may be a finger of a 2 finger gesture.
+    static void markThumb(VoodooInputEvent &event, int count, int thumb)
+    {
+        if (thumb < 0 || thumb >= count || count < 3)
+            return;
+        auto &transducer = event.transducers[thumb];
+        for (int i = 0; i < count; i++) {
+            if (event.transducers[i].fingerType == kMT2FingerTypeThumb) {
+                event.transducers[i].fingerType = transducer.fingerType;
+                break;
+            }
+        }
+        transducer.fingerType = kMT2FingerTypeThumb;
+    }
+    // Clickpads only report the button through the transducers, so the click of a
+    // rejected contact (disable zone or palm) goes to the first transducer sent. With
+    // none left, it is sent on a transducer that is not valid, which has no position.
+    static void keepRejectedButton(VoodooInputEvent &event, int &count, bool button, bool forceTouchButton)
+    {
+        if (!button)
+            return;
+        if (count > 0) {
+            auto &transducer = event.transducers[0];
+            if (forceTouchButton) {
+                // the button is a force touch in this mode
+                transducer.supportsPressure = true;
+                transducer.currentCoordinates.pressure = 255;
+            } else {
+                transducer.isPhysicalButtonDown = true;
+            }
+        } else if (!forceTouchButton) {
+            auto &transducer = event.transducers[count++];
+            transducer.type = FINGER;
+            transducer.isValid = false;
+            transducer.isTransducerActive = false;
+            transducer.isPhysicalButtonDown = true;
+            transducer.fingerType = kMT2FingerTypeUndefined;
+        }
+    }
+};
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 // Force Touch Modes
 //
@@ -157,4 +539,161 @@ typedef enum {
     FORCE_TOUCH_CUSTOM = 4
 } ForceTouchMode;
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// ForceTouchCurve Class Declaration
+//
+// Pressure curve for FORCE_TOUCH_CUSTOM. Maps a raw pressure value to
+// 255 * ((pressure - up) / (down - up)) ^ power, clamped to [0, 255].
+// The table is rebuilt when the thresholds or the power change, so the
+// packet path is a single lookup.
+//
+
+class ForceTouchCurve
+{
+private:
+    UInt8 m_table[256];
+
+public:
+    inline ForceTouchCurve() { bzero(m_table, sizeof(m_table)); }
+    void build(int up, int down, int power)
+    {
+        for (int pressure = 0; pressure < 256; pressure++) {
+            double value;
+            if (pressure >= down) {
+                value = 1.0;
+            } else if (pressure <= up) {
+                value = 0.0;
+            } else {
+                double base = ((double) (pressure - up)) / ((double) (down - up));
+                value = 1;
+                for (int i = 0; i < power; ++i) {
+                    value *= base;
+                }
+            }
+            m_table[pressure] = (UInt8) (value * 255);
+        }
+    }
+    inline UInt8 map(int pressure) const
+    {
+        if (pressure < 0)
+            pressure = 0;
+        else if (pressure > 255)
+            pressure = 255;
+        return m_table[pressure];
+    }
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// TrackpointCurve Class Declaration
+//
+// Pointer acceleration for trackpoint deltas, applied before they are handed
+// to VoodooInput (which still does the multiplier, divisor and deadzone).
+// The gain is a table indexed by speed in counts per packet, rebuilt when the
+// TrackpointCurve dictionary changes:
+//   gain = Sensitivity% * (1 + Acceleration% * ((speed - Threshold) / span) ^ 2)
+// Fractions of a count are carried to the next packet, so slow motion with a
+// gain below 1 still moves. Smoothing (0-3) averages the last packets.
+// The defaults are the identity and leave the deltas untouched.
+//
+
+#define kTrackpointCurveSpeeds      256
+#define kTrackpointCurveSpan        64
+#define kTrackpointCurveIdleNs      100000000ULL
+
+class TrackpointCurve
+{
+private:
+    UInt32 m_gain[kTrackpointCurveSpeeds];  // 8.8 fixed point
+    SInt64 m_remainderX, m_remainderY;      // 16.16 fixed point
+    int m_smoothX, m_smoothY;               // 24.8 fixed point
+    uint64_t m_lastTime;
+    bool m_identity;
+
+public:
+    int sensitivity {100};
+    int acceleration {0};
+    int threshold {4};
+    int smoothing {0};
+
+    inline TrackpointCurve() { build(); }
+    inline void reset()
+    {
+        m_remainderX = m_remainderY = 0;
+        m_smoothX = m_smoothY = 0;
+    }
+    void build()
+    {
+        if (sensitivity < 1)
+            sensitivity = 1;
+        if (threshold < 0)
+            threshold = 0;
+        if (smoothing < 0)
+            smoothing = 0;
+        else if (smoothing > 3)
+            smoothing = 3;
+        SInt64 base = (SInt64)sensitivity * 256 / 100;
+        for (int speed = 0; speed < kTrackpointCurveSpeeds; speed++) {
+            SInt64 t = speed - threshold;
+            if (t < 0)
+                t = 0;
+            else if (t > kTrackpointCurveSpan)
+                t = kTrackpointCurveSpan;
+            SInt64 gain = base + base * acceleration * t * t / (100 * kTrackpointCurveSpan * kTrackpointCurveSpan);
+            m_gain[speed] = gain > 0 ? (UInt32)gain : 0;
+        }
+        m_identity = sensitivity == 100 && acceleration == 0 && smoothing == 0;
+        m_lastTime = 0;
+        reset();
+    }
+    void load(OSDictionary *config)
+    {
+        if (!config)
+            return;
+        const struct {const char *name; int *var;} vars[] = {
+            {"Sensitivity",     &sensitivity},
+            {"Acceleration",    &acceleration},
+            {"Threshold",       &threshold},
+            {"Smoothing",       &smoothing},
+        };
+        for (int i = 0; i < 4; i++)
+            if (OSNumber *num = OSDynamicCast(OSNumber, config->getObject(vars[i].name)))
+                *vars[i].var = num->unsigned32BitValue();
+        build();
+    }
+    // VoodooInput turns the deltas into scrolling while the middle button is
+    // held, those bypass the curve like the ALPS scroll wheel events do
+    void apply(int &dx, int &dy, uint64_t now_ns, bool middleButton)
+    {
+        if (middleButton) {
+            reset();
+            return;
+        }
+        if (m_identity)
+            return;
+        if (now_ns - m_lastTime > kTrackpointCurveIdleNs)
+            reset();
+        m_lastTime = now_ns;
+
+        int sx = dx * 256, sy = dy * 256;
+        if (smoothing) {
+            sx = m_smoothX = (m_smoothX * smoothing + sx) / (smoothing + 1);
+            sy = m_smoothY = (m_smoothY * smoothing + sy) / (smoothing + 1);
+        }
+        int speed = ((sx < 0 ? -sx : sx) + (sy < 0 ? -sy : sy)) / 256;
+        UInt32 gain = m_gain[speed < kTrackpointCurveSpeeds ? speed : kTrackpointCurveSpeeds - 1];
+
+        // a fraction left over from the other direction would only add lag
+        if ((SInt64)sx * m_remainderX < 0)
+            m_remainderX = 0;
+        if ((SInt64)sy * m_remainderY < 0)
+            m_remainderY = 0;
+        m_remainderX += (SInt64)sx * gain;
+        m_remainderY += (SInt64)sy * gain;
+        dx = (int)(m_remainderX / 65536);
+        dy = (int)(m_remainderY / 65536);
+        m_remainderX -= (SInt64)dx * 65536;
+        m_remainderY -= (SInt64)dy * 65536;
+    }
+};
+
 #endif /* VoodooPS2TrackpadCommon_h */